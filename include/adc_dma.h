@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+#include "board.h"
+
+// Background ADC1 acquisition: the continuous (DMA) driver converts the ADC1
+// sinks round-robin and every finished frame is sorted into per-sink rings from
+// the DMA callback, so a reading is a copy of the newest samples instead of a
+// run of analogRead() calls. The ESP32 DMA only serves ADC1; the ADC2 sinks and
+// the INA current pins keep using analogRead().
+//
+// Samples taken before the last tester output change (DAC or MCP23017 write)
+// are stale, a read waits until enough samples taken after it arrived.
+
+#define ADC_DMA_SAMPLE_FREQ_HZ 200000  // All channels together
+#define ADC_DMA_RING_SIZE      32      // Samples kept per sink, power of two
+
+typedef struct {
+    int median;             // Median of the samples, raw ADC counts
+    int mean;               // Mean of the samples, raw ADC counts
+    uint32_t timestamp_us;  // esp_timer time of the newest sample
+} adc_dma_value_t;
+
+// Start converting, does nothing when running. Call after hal_adc_calibrate(),
+// which reads the ADC1 sinks with analogRead()
+bool adc_dma_start();
+// Stop and release the ADC, so another continuous user (Sigscoper) can take it.
+// With adc1_taken the ADC1 sinks cannot be sampled on demand until
+// adc_dma_start() finds ADC1 free again
+void adc_dma_stop(bool adc1_taken);
+// Engine running and the sink is on ADC1
+bool adc_dma_covers(ADC_sink_t sink);
+// Samples converted until now are stale, call after changing a tester output
+void adc_dma_mark_stimulus();
+// Median and mean of the newest count fresh samples, waits for them up to a few
+// frames; false when the engine does not cover the sink or stalls
+bool adc_dma_read(ADC_sink_t sink, size_t count, adc_dma_value_t* value);
+// analogRead() of an ADC1 sink fails while a continuous driver holds ADC1, so
+// the engine is stopped for on-demand reads and restarted by adc_dma_oneshot_end().
+// False when another continuous user holds ADC1 and the sink cannot be read
+bool adc_dma_oneshot_begin(ADC_sink_t sink, bool* resume);
+void adc_dma_oneshot_end(bool resume);
@@ -6,6 +6,7 @@ const int PIN_SDA = 21;
 
 const int PIN_IO0_RST = 23;
 const int PIN_IO1_RST = 19;
+const int PIN_IO1_INT = -1;  // MCP1 INTA/INTB (mirrored), -1 while not routed to an ESP32 GPIO
 
 const int PIN_MOSI = 18;
 const int PIN_SCK = 5;
@@ -64,6 +65,31 @@ typedef enum {
     IO15 = 15
 } mcp_io_t;
 
+typedef enum {
+    SOURCE_A,
+    SOURCE_B,
+    SOURCE_C,
+    SOURCE_D,
+    SOURCE_COUNT
+} source_net_t;
+
+// Signal generator waveforms
+typedef enum {
+    SIGNAL_SINE,
+    SIGNAL_SQUARE,    // offset ± amplitude, high for the duty cycle
+    SIGNAL_TRIANGLE,
+    SIGNAL_SAW,       // Rising ramp
+    SIGNAL_PULSE,     // offset + amplitude for the duty cycle, offset otherwise
+    SIGNAL_SHAPE_COUNT
+} signal_shape_t;
+
+// IO states
+typedef enum {
+    IO_LOW = 0,
+    IO_HIGH = 1,
+    IO_INPUT = 2
+} io_state_t;
+
 typedef enum {
     ADC_sink_1k_A,
     ADC_sink_1k_B,
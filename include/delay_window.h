@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include "script_registry.h"
+
+// Pending delay of execute_test_sequence(): a delay op becomes a deadline, and
+// the next operation that has to wait for it (see script_op_runs_in_delay())
+// sleeps until then. Header-only so the host test runs the interpreter's rule.
+
+typedef struct {
+    bool pending;
+    uint32_t until;     // millis() deadline
+} delay_window_t;
+
+// Open the window at now, or extend a running one: back-to-back delays add up
+static inline void delay_window_add(delay_window_t* window, uint32_t now, int32_t ms) {
+    uint32_t from = (window->pending && (int32_t)(window->until - now) > 0) ? window->until : now;
+    window->until = from + (ms > 0 ? ms : 0);
+    window->pending = true;
+}
+
+// Milliseconds to sleep before op starts at now, closing the window when op has
+// to wait for it. A null op always waits (loop ends, the end of the range).
+static inline uint32_t delay_window_wait(delay_window_t* window, const test_operation_t* op, uint32_t now) {
+    if (!window->pending || (op && script_op_runs_in_delay(*op))) {
+        return 0;
+    }
+    window->pending = false;
+    int32_t left = (int32_t)(window->until - now);
+    return left > 0 ? (uint32_t)left : 0;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include "goertzel.h"
+
+// Frequency of a periodic signal from a raw capture, in cycles per sample:
+// the rising crossings of the midpoint between the extremes are timed by
+// linear interpolation between the samples around them, so a capture of a
+// few periods resolves a small fraction of a sample per period. When the
+// periods between crossings scatter (noise around the midpoint, a slow
+// edge), the estimate is refined on the peak of the Goertzel spectrum
+// around it instead. Multiply by the true sample rate for Hz.
+//
+// Shared by the firmware and the script linter, which plans the captures
+// of "freq" checks the same way.
+
+#define FREQ_HYSTERESIS_DIV   4       // Re-arm below the midpoint by this fraction of the swing
+#define FREQ_JITTER_REFINE    0.002   // Relative period scatter above which Goertzel refines
+#define FREQ_REFINE_PASSES    3
+
+// Capture planning for "freq" checks without a scope of their own
+#define FREQ_SAMPLES_PER_PERIOD 16    // At the highest expected frequency
+#define FREQ_CYCLES             16    // Periods of the lowest expected frequency in a capture
+#define FREQ_BUFFER_MIN         512
+#define FREQ_BUFFER_MAX         4096  // Samples a check reads from Sigscoper
+
+// Sample rates automatic captures pick from, so each is measured once (see start_sigscoper())
+static const uint32_t SCOPE_RATES[] = {1000, 2000, 5000, 10000, 20000, 50000, 100000};
+#define SCOPE_RATE_COUNT (sizeof(SCOPE_RATES) / sizeof(SCOPE_RATES[0]))
+
+// Lowest scope rate at or above rate, the highest one when none is
+static inline uint32_t scope_rate_at_least(double rate) {
+    for (size_t i = 0; i < SCOPE_RATE_COUNT; i++) {
+        if (SCOPE_RATES[i] >= rate) {
+            return SCOPE_RATES[i];
+        }
+    }
+    return SCOPE_RATES[SCOPE_RATE_COUNT - 1];
+}
+
+// Highest scope rate at or below rate, the lowest one when none is
+static inline uint32_t scope_rate_at_most(double rate) {
+    for (size_t i = SCOPE_RATE_COUNT; i-- > 0;) {
+        if (SCOPE_RATES[i] <= rate) {
+            return SCOPE_RATES[i];
+        }
+    }
+    return SCOPE_RATES[0];
+}
+
+// Sample rate of a check expecting up to max_hz
+static inline uint32_t freq_capture_rate(int32_t max_hz) {
+    return scope_rate_at_least((double)max_hz * FREQ_SAMPLES_PER_PERIOD);
+}
+
+// Samples of a capture at rate that hold FREQ_CYCLES periods of min_hz
+static inline size_t freq_capture_buffer(uint32_t rate, int32_t min_hz) {
+    double samples = min_hz > 0 ? ceil((double)rate * FREQ_CYCLES / min_hz) : FREQ_BUFFER_MAX;
+    if (samples < FREQ_BUFFER_MIN) {
+        return FREQ_BUFFER_MIN;
+    }
+    return samples > FREQ_BUFFER_MAX ? FREQ_BUFFER_MAX : (size_t)samples;
+}
+
+typedef struct {
+    double freq;        // Cycles per sample, 0 without two rising crossings
+    size_t periods;     // Periods between the first and the last crossing
+    double jitter;      // Standard deviation of the periods over their mean
+    bool refined;       // Taken from the Goertzel peak
+} freq_estimate_t;
+
+// Move freq to the nearest peak of the windowed spectrum by parabolic
+// interpolation of the log magnitude, three Goertzel runs per pass
+template <typename T>
+inline double freq_refine(const T* samples, size_t count, double freq) {
+    for (int pass = 0; pass < FREQ_REFINE_PASSES; pass++) {
+        double step = 0.25 / count;  // A quarter of a DFT bin
+        double below = log(goertzel(samples, count, freq - step).amplitude + 1e-9);
+        double at = log(goertzel(samples, count, freq).amplitude + 1e-9);
+        double above = log(goertzel(samples, count, freq + step).amplitude + 1e-9);
+        double curvature = below - 2 * at + above;
+        if (!(curvature < 0)) {
+            break;
+        }
+        double offset = 0.5 * (below - above) / curvature;
+        offset = offset < -4 ? -4 : offset > 4 ? 4 : offset;
+        freq += offset * step;
+        if (fabs(offset) < 0.01) {
+            break;
+        }
+    }
+    return freq;
+}
+
+template <typename T>
+inline freq_estimate_t freq_estimate(const T* samples, size_t count) {
+    freq_estimate_t result = {0, 0, 0, false};
+    if (count < 3) {
+        return result;
+    }
+    T low = samples[0];
+    T high = samples[0];
+    for (size_t n = 1; n < count; n++) {
+        low = samples[n] < low ? samples[n] : low;
+        high = samples[n] > high ? samples[n] : high;
+    }
+    double mid = (low + (double)high) / 2;
+    double rearm = mid - (high - (double)low) / FREQ_HYSTERESIS_DIV;
+
+    bool armed = false;
+    double first = 0;
+    double last = 0;
+    double sum = 0;
+    double sum_sq = 0;
+    size_t crossings = 0;
+    for (size_t n = 1; n < count; n++) {
+        if (samples[n] < rearm) {
+            armed = true;
+        } else if (armed && samples[n - 1] < mid && samples[n] >= mid) {
+            double t = n - 1 + (mid - samples[n - 1]) / ((double)samples[n] - samples[n - 1]);
+            if (crossings > 0) {
+                sum += t - last;
+                sum_sq += (t - last) * (t - last);
+            } else {
+                first = t;
+            }
+            last = t;
+            crossings++;
+            armed = false;
+        }
+    }
+    if (crossings < 2) {
+        return result;
+    }
+
+    result.periods = crossings - 1;
+    result.freq = result.periods / (last - first);
+    double mean = sum / result.periods;
+    double variance = sum_sq / result.periods - mean * mean;
+    result.jitter = variance > 0 ? sqrt(variance) / mean : 0;
+    if (result.jitter > FREQ_JITTER_REFINE) {
+        result.freq = freq_refine(samples, count, result.freq);
+        result.refined = true;
+    }
+    return result;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include "freq_estimate.h"
+
+// Plan of a frequency sweep ("sweep" op), shared by the firmware and the
+// script linter: the points are spaced logarithmically between the start and
+// stop frequencies, and every point captures SWEEP_BUFFER samples at the
+// highest scope rate (SCOPE_RATES) that still fits SWEEP_CYCLES periods of
+// the stimulus, so a point takes about the same number of periods at 20 Hz
+// as at 5 kHz.
+
+#define SWEEP_POINTS_MAX      32
+#define SWEEP_BUFFER          1024    // Samples per point
+#define SWEEP_CYCLES          8       // Fewest stimulus periods per capture, below the top rate
+#define SWEEP_SETTLE_MS       20      // Wait after a frequency step before capturing...
+#define SWEEP_SETTLE_PERIODS  4       // ...or this many periods, whichever is longer
+#define SWEEP_AMPLITUDE_MV    1000    // Sine stimulus around 0 V
+#define SWEEP_GENERATOR_RATE  20000   // Signal generator timer (SIGNAL_SAMPLE_RATE_HZ), for its hold droop
+
+// Frequency of point i in Hz, start and stop in mHz
+static inline double sweep_point_freq(int32_t start_mhz, int32_t stop_mhz, int points, int i) {
+    if (points < 2) {
+        return start_mhz / 1000.0;
+    }
+    return start_mhz / 1000.0 * pow((double)stop_mhz / start_mhz, (double)i / (points - 1));
+}
+
+// Sigscoper sample rate of a point at freq Hz
+static inline uint32_t sweep_sample_rate(double freq) {
+    return scope_rate_at_most(freq * SWEEP_BUFFER / SWEEP_CYCLES);
+}
+
+// Time the module gets after a step to freq Hz before the capture starts
+static inline uint32_t sweep_settle_ms(double freq) {
+    uint32_t periods_ms = (uint32_t)ceil(SWEEP_SETTLE_PERIODS * 1000.0 / freq);
+    return periods_ms > SWEEP_SETTLE_MS ? periods_ms : SWEEP_SETTLE_MS;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <math.h>
+
+// Single-frequency DFT of a capture by the generalized Goertzel recurrence:
+// one multiply-add per sample at any frequency, not only at the bins of the
+// capture length. The mean is removed and a Hann window applied, so a tone
+// with a fractional number of cycles in the capture leaks little into its
+// neighbours and none of the DC offset reaches the result. Runs in double,
+// the recurrence loses too much in float over a thousand samples.
+
+typedef struct {
+    float amplitude;  // Peak amplitude of the component, in the units of the samples
+    float phase;      // Phase in radians of the cosine at the first sample, -pi..pi
+} goertzel_result_t;
+
+// Component at freq cycles per sample (f / fs) of count samples, in millivolts or raw ADC codes
+template <typename T>
+inline goertzel_result_t goertzel(const T* samples, size_t count, double freq) {
+    goertzel_result_t result = {0, 0};
+    if (count < 2) {
+        return result;
+    }
+
+    double mean = 0;
+    for (size_t n = 0; n < count; n++) {
+        mean += samples[n];
+    }
+    mean /= count;
+
+    // Periodic Hann window, its cosine stepped by rotation rather than cos() per sample
+    const double step = 2 * M_PI / count;
+    const double step_cos = cos(step);
+    const double step_sin = sin(step);
+    double window_cos = 1;
+    double window_sin = 0;
+
+    const double omega = 2 * M_PI * freq;
+    const double coeff = 2 * cos(omega);
+    double s1 = 0;
+    double s2 = 0;
+    for (size_t n = 0; n < count; n++) {
+        double window = 0.5 - 0.5 * window_cos;
+        double s0 = (samples[n] - mean) * window + coeff * s1 - s2;
+        s2 = s1;
+        s1 = s0;
+        double next_cos = window_cos * step_cos - window_sin * step_sin;
+        window_sin = window_sin * step_cos + window_cos * step_sin;
+        window_cos = next_cos;
+    }
+
+    // y = s1 - e^(-j omega) s2 is the DFT referred to the last sample, rotate it back to the first
+    double re = s1 - cos(omega) * s2;
+    double im = sin(omega) * s2;
+    double back = -omega * (count - 1);
+    double x_re = re * cos(back) - im * sin(back);
+    double x_im = re * sin(back) + im * cos(back);
+
+    // A cosine of amplitude A gives A / 2 times the window sum, which is count / 2
+    result.amplitude = (float)(4 * sqrt(x_re * x_re + x_im * x_im) / count);
+    result.phase = (float)atan2(x_im, x_re);
+    return result;
+}
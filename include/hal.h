@@ -8,66 +8,130 @@
 #include <DAC8552.h>
 #include <esp_log.h>
 
-// Micro_MCP23X17 class - extended MCP23X17 with bulk mode and pullup control
+// Micro_MCP23X17 class - extended MCP23X17 with bulk mode, pullup control and
+// shadow copies of the IODIR, OLAT and GPPU registers of both ports.
+// Pin writes never read the chip and only write registers whose value changes.
 class Micro_MCP23X17 : public Adafruit_MCP23X17 {
 public:
+    // Load the shadow registers from the chip, call after begin_I2C() or a chip reset
+    void syncCache();
+
+    // Update the shadow registers only, flush() writes them
+    void setPinMode(uint8_t pin, uint8_t mode);
+    void setPinLevel(uint8_t pin, uint8_t value);
+
+    // Write every changed register once: OLAT first, so a pin turning into an
+    // output drives its new level from the start, then GPPU and IODIR
+    void flush();
+
+    // Adafruit pin calls through the shadow registers, written at once
+    void pinMode(uint8_t pin, uint8_t mode);
+    void digitalWrite(uint8_t pin, uint8_t value);
+
     // Bulk write pin modes for a port
     void writeMode(uint8_t value, uint8_t port);
     
     // Bulk write pullup configuration for a port
     void writePullup(uint8_t value, uint8_t port);
+
+private:
+    enum { REG_IODIR, REG_GPPU, REG_OLAT, REG_COUNT };
+
+    void writeRegister(uint8_t reg);
+
+    uint16_t shadow[REG_COUNT] = {0xFFFF, 0x0000, 0x0000};   // Port A in the low byte, power-on values
+    uint16_t written[REG_COUNT] = {0xFFFF, 0x0000, 0x0000};  // Last values written to the chip
 };
 
 // Global objects
 extern SPIClass SPI_DAC;
 extern Micro_MCP23X17 mcp0;  // addr 0x20
-extern Adafruit_MCP23X17 mcp1;  // addr 0x21
+extern Micro_MCP23X17 mcp1;  // addr 0x21
+
+// Reading of a sink that could not be sampled (ADC1 held by Sigscoper), outside every range
+#define HAL_ADC_INVALID INT32_MIN
 
 // Current measurement functions
 int32_t measure_current(uint8_t pin);
 int32_t measure_current_raw(uint8_t pin);
 void hal_current_calibrate();
+// Millivolts of one sink, HAL_ADC_INVALID if it cannot be sampled
 int32_t hal_adc_read(ADC_sink_t idx);
 int32_t hal_adc_raw2mv(int32_t raw, ADC_sink_t idx);
+// Median of size samples, the median.h network for MEDIAN_FILTER_SIZE samples
+int get_median(int arr[], int size);
+// Median-filtered reading of several sinks, sampled interleaved in one sweep;
+// HAL_ADC_INVALID for sinks that cannot be sampled
+void hal_adc_read_multi(const ADC_sink_t* sinks, size_t count, int32_t* millivolts);
+
+// Range checks that stop sampling once the median's side of [min, max] is decided,
+// return the median of the samples taken
+int32_t hal_adc_read_range(ADC_sink_t idx, int32_t min_mv, int32_t max_mv, bool* in_range);
+int32_t measure_current_range(uint8_t pin, int32_t min_ua, int32_t max_ua, bool* in_range);
 void hal_print_current(void);
 void hal_clear_console(void);
 
-typedef enum {
-    SOURCE_A,
-    SOURCE_B,
-    SOURCE_C,
-    SOURCE_D,
-    SOURCE_COUNT
-} source_net_t; 
-
 // DAC control functions
 void dac_init();
 void write_dac(int cs_pin, uint8_t channel, uint16_t value);
 void hal_set_source(source_net_t net, int32_t voltage_mv);
 void hal_set_source_direct(source_net_t net, uint16_t dac_value);
+// Step a source through DAC codes while a loopback feeds it to sink, fit gain and
+// offset and store the resulting LUT; max_error_mv is the worst residual of the fit
+bool hal_source_calibrate(source_net_t net, ADC_sink_t sink, int32_t* max_error_mv);
+// Load the LUTs stored by hal_source_calibrate(), ideal codes when there are none
+void hal_source_calibration_load();
+
+// Signal generator waveform: offset_mv + amplitude_mv times the shape, which swings
+// -1..+1 (0..+1 for SIGNAL_PULSE)
+typedef struct {
+    signal_shape_t shape;
+    int32_t amplitude_mv;
+    int32_t offset_mv;
+    uint8_t duty;         // Percent of the period square and pulse spend high
+} signal_wave_t;
 
-// Signal generator functions
-void hal_start_signal(source_net_t pin, float freq);
+// Signal generator functions, a 2500 mV sine around 0 V without a wave
+void hal_start_signal(source_net_t pin, double freq, const signal_wave_t* wave = nullptr);
 void hal_stop_signal(source_net_t pin);
+// Phase accumulator of a running signal, 2^32 per period, counted from 0 at hal_start_signal()
+uint32_t hal_signal_phase(source_net_t pin);
+// Play a sample file from WAVE_DIR (see wave_player.h) at rate_hz samples per
+// second, up to the generator rate; false when the file cannot be played
+bool hal_start_wave(source_net_t pin, uint32_t name_hash, uint32_t rate_hz, bool loop);
 
 // MCP initialization
 void mcp_init();
 
+// Power rail monitor: a background task keeps the debounced PASS pin levels,
+// woken by the MCP1 interrupt-on-change (or polling when PIN_IO1_INT is -1)
+#define RAILS_BIT_12V  (1 << 0)
+#define RAILS_BIT_5V   (1 << 1)
+#define RAILS_BIT_M12V (1 << 2)  // Already corrected for the inverted PASS signal
+#define RAILS_BITS_ALL (RAILS_BIT_12V | RAILS_BIT_5V | RAILS_BIT_M12V)
+
+void hal_rails_monitor_start();
+// Last published rail state, RAILS_BIT_* set for connected rails, no bus access
+uint8_t hal_rails_state();
+// Block until all rails are connected (connected = true) or all are disconnected
+void hal_rails_wait(bool connected);
+
 // Function declarations
 void hal_init();
 void hal_adc_calibrate();
+// Use the calibration stored by hal_calibration_save() when it was measured on
+// this fixture, is not stale and still matches a quick reading of every input
+bool hal_calibration_load();
+void hal_calibration_save();
 uint8_t hal_adapter_id();
 
-// IO states
-typedef enum {
-    IO_LOW = 0,
-    IO_HIGH = 1,
-    IO_INPUT = 2
-} io_state_t;
-
 // IO control functions
 void hal_set_io(mcp_io_t io_pin, io_state_t state);
 void hal_reset_io();
+// Set the pins in mask together: inputs become HiZ, the others outputs at their bit in levels
+void hal_set_io_port(uint16_t mask, uint16_t levels, uint16_t inputs);
+// Levels of all 16 IO pins from one GPIO register read, bit n = IO n
+uint16_t hal_read_io_port();
 
 // External objects
 extern DAC8552 dac1;
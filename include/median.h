@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stddef.h>
+#include <algorithm>
+#include <utility>
+
+// Median of a fixed number of samples by a selection network: Batcher's
+// odd-even merge sort for N elements, built at compile time and pruned to
+// the comparators the middle element depends on. Every comparator is a
+// min/max pair, so the kernel has no data-dependent branches and the
+// samples stay in registers.
+
+namespace median_detail {
+
+typedef struct {
+    unsigned char a, b;  // Compare-exchange: a gets the minimum, b the maximum
+} comparator_t;
+
+template <size_t N>
+struct network_t {
+    comparator_t pairs[N * N];
+    size_t count = 0;
+};
+
+// Batcher's odd-even merge sort, iterative form valid for any N
+template <size_t N>
+constexpr network_t<N> batcher() {
+    network_t<N> net{};
+    for (size_t p = 1; p < N; p <<= 1) {
+        for (size_t k = p; k >= 1; k >>= 1) {
+            for (size_t j = k % p; j + k < N; j += 2 * k) {
+                for (size_t i = 0; i < k && i + j + k < N; i++) {
+                    if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) {
+                        net.pairs[net.count++] = {(unsigned char)(i + j), (unsigned char)(i + j + k)};
+                    }
+                }
+            }
+        }
+    }
+    return net;
+}
+
+// Keep only comparators that can move a value into the middle position
+template <size_t N>
+constexpr network_t<N> select_middle() {
+    network_t<N> sorted = batcher<N>();
+    bool needed[N] = {};
+    bool keep[N * N] = {};
+    needed[N / 2] = true;
+    for (size_t c = sorted.count; c-- > 0;) {
+        const comparator_t& pair = sorted.pairs[c];
+        if (needed[pair.a] || needed[pair.b]) {
+            keep[c] = needed[pair.a] = needed[pair.b] = true;
+        }
+    }
+    network_t<N> net{};
+    for (size_t c = 0; c < sorted.count; c++) {
+        if (keep[c]) {
+            net.pairs[net.count++] = sorted.pairs[c];
+        }
+    }
+    return net;
+}
+
+template <size_t N>
+struct middle_network {
+    static constexpr network_t<N> net = select_middle<N>();
+};
+
+inline void compare_exchange(int& a, int& b) {
+    int low = std::min(a, b);
+    b = std::max(a, b);
+    a = low;
+}
+
+template <size_t N, size_t... I>
+inline void run(int* v, std::index_sequence<I...>) {
+    (compare_exchange(v[middle_network<N>::net.pairs[I].a], v[middle_network<N>::net.pairs[I].b]), ...);
+}
+
+}  // namespace median_detail
+
+// Comparators in the N-sample median network
+template <size_t N>
+constexpr size_t median_network_size() {
+    return median_detail::middle_network<N>::net.count;
+}
+
+// Median of exactly N samples, the input is left untouched
+template <size_t N>
+inline int median_fixed(const int* values) {
+    static_assert(N > 0 && N < 256, "median_fixed: unsupported size");
+    int v[N];
+    for (size_t i = 0; i < N; i++) {
+        v[i] = values[i];
+    }
+    median_detail::run<N>(v, std::make_index_sequence<median_network_size<N>()>{});
+    return v[N / 2];
+}
+
+// Median of any number of samples up to 64, for partial sample sets
+inline int median_any(const int* values, size_t count) {
+    int v[64];
+    count = std::min(count, sizeof(v) / sizeof(v[0]));
+    if (count == 0) {
+        return 0;
+    }
+    std::copy(values, values + count, v);
+    std::nth_element(v, v + count / 2, v + count);
+    return v[count / 2];
+}
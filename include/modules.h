@@ -3,41 +3,10 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "test_helpers.h"
+#include "test_ops.h"
 
-// Test operation types
-typedef enum {
-    TEST_OP_SOURCE,      // Set voltage source
-    TEST_OP_SOURCE_SIG,  // Start signal generator
-    TEST_OP_IO,          // Set IO pin state
-    TEST_OP_SINK_PD,     // Set sink pulldown
-    TEST_OP_CHECK_CURRENT, // Check current consumption
-    TEST_OP_CHECK_PIN,   // Check pin voltage
-    TEST_OP_RESET,       // Reset all pins to safe state
-    TEST_OP_SCOPE,       // Start Sigscoper in FREE mode
-    TEST_OP_CHECK_MIN,   // Check minimum signal value
-    TEST_OP_CHECK_MAX,   // Check maximum signal value
-    TEST_OP_CHECK_AVG,   // Check average signal value
-    TEST_OP_CHECK_FREQ,  // Check signal frequency
-    TEST_OP_CHECK_AMPLITUDE, // Check signal amplitude (max - min)
-    TEST_OP_DELAY,       // Delay for specified time in milliseconds
-    TEST_OP_CHECK_IO_LEVEL // Check IO pin level
-} test_op_type_t;
-
-// Test operation structure
-typedef struct {
-    bool repeat;           // Use TEST_RUN_REPEAT if true, TEST_RUN if false
-    test_op_type_t op;    // Operation type
-    int pin;              // Pin number
-    int32_t arg1;         // Voltage for SOURCE, state for IO, 0/1 for SINK_PD, low value for checks
-    int32_t arg2;         // High value for checks (only used for CHECK_CURRENT and CHECK_PIN)
-} test_operation_t;
-
-// Test result structure
-typedef struct {
-    bool passed;          // true if test passed, false if failed
-    int32_t result;       // actual value obtained from the operation (if test failed)
-    uint32_t execution_time_ms; // execution time in milliseconds
-} test_operation_result_t;
+// Adapter IDs are 5 bits wide, module scripts are named "NN_<name>" with NN below this
+#define MODULE_ID_COUNT 32
 
 /**
  * @brief Module information structure
@@ -48,20 +17,44 @@ typedef struct {
     const test_operation_t* test_operations;  // Array of test operations
     size_t test_operations_count;        // Number of test operations
     test_operation_result_t* test_results;         // Array of test results (same size as test_operations)
-    int loop_start;                      // Index of first operation in loop, or -1 if no loop
-    int loop_end;                        // Index of last operation in loop, or -1 if no loop
+    const test_alias_t* aliases;         // Pin aliases referenced by test_operation_t::alias
+    size_t alias_count;                  // Number of aliases
+    const test_group_t* groups;          // Test groups from "# # name" headers
+    size_t group_count;                  // Number of groups
+    bool retest_groups;                  // Retry a failed run from the failed group
+    test_limits_t limits;                // Script deadlines and retry backoff
 } module_info_t;
 
-// Initialize modules from filesystem
+/**
+ * @brief Load every script in /modules into the module arena
+ *
+ * Programs are packed into one allocation indexed by adapter ID, so
+ * switching adapters is a lookup. Calling it again rebuilds the arena;
+ * previously returned module_info_t pointers become invalid.
+ */
 bool init_modules_from_fs();
 
+// Ask the main loop to rebuild the arena, safe to call from the web server task
+void request_modules_reload();
+
+/**
+ * @brief Rebuild the arena if a reload was requested
+ *
+ * Must only be called between runs, when no module_info_t pointer is held.
+ * Returns false only if a requested rebuild failed.
+ */
+bool reload_modules_if_requested();
+
 // Set current module index
 void set_current_module_index(size_t index);
 
 // Get current module index
 size_t get_current_module_index();
 
-// Get module info by ID
+// Get module info by adapter ID, nullptr if no script exists for it
+module_info_t* get_module_info(size_t id);
+
+// Get module info for the current module index
 module_info_t* get_current_module_info();
 
 // Get modules array (for internal use)
@@ -70,5 +63,28 @@ module_info_t* get_modules_array();
 // Get modules count (for test results)
 size_t get_modules_count();
 
-// Execute module tests using declarative approach
-bool execute_module_tests(module_info_t* module); 
\ No newline at end of file
+/**
+ * @brief Name of the pin an operation refers to
+ *
+ * Returns the script alias if the operation has one, otherwise the pin's
+ * script name (IO pins are formatted into buf).
+ *
+ * @return Pin name, or nullptr if the operation has no pin argument
+ */
+const char* get_operation_pin_name(const module_info_t* module, const test_operation_t& op, char* buf, size_t size);
+
+/**
+ * @brief Group an operation belongs to
+ *
+ * @return The group, or nullptr if the operation precedes the first "# # name" header
+ */
+const test_group_t* get_operation_group(const module_info_t* module, size_t op_index);
+
+/**
+ * @brief Execute module tests using declarative approach
+ *
+ * @param retest true when retrying after a failed run of the same unit. Scripts
+ *               with "# retest groups" then re-run their "setup" group and
+ *               continue from the group that failed; others start over.
+ */
+bool execute_module_tests(module_info_t* module, bool retest = false);
\ No newline at end of file
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "test_ops.h"
+
+// Longest script line the parser accepts (comment lines may be longer)
+#define SCRIPT_LINE_MAX 256
+
+// Initial capacity of the operations array, doubled whenever it fills up
+#define SCRIPT_OPS_INITIAL_CAPACITY 16
+
+// Initial capacity of the alias table, doubled whenever it fills up
+#define SCRIPT_ALIASES_INITIAL_CAPACITY 8
+
+// Initial capacity of the group table, doubled whenever it fills up
+#define SCRIPT_GROUPS_INITIAL_CAPACITY 8
+
+// Deepest loop nesting the parser and interpreter support
+#define SCRIPT_LOOP_DEPTH_MAX 8
+
+// Retry delay of repeat ops unless a "# backoff" line changes it
+#define SCRIPT_BACKOFF_DEFAULT_MS 10
+
+// Argument limits enforced by the hardware, see hal_set_source() and hal_start_signal()
+#define SCRIPT_SOURCE_MV_MIN -5000
+#define SCRIPT_SOURCE_MV_MAX 5000
+#define SCRIPT_SIGNAL_FREQ_MAX 10000    // Nyquist limit of the 20 kHz generator timer
+#define SCRIPT_SWEEP_FREQ_MIN 10        // SWEEP_CYCLES periods fit a capture at the lowest sample rate
+#define SCRIPT_SIGNAL_AMPLITUDE_DEFAULT 2500
+#define SCRIPT_SIGNAL_DUTY_DEFAULT 50   // Percent, square and pulse only
+#define SCRIPT_WAVE_RATE_MAX 20000      // Generator timer, one sample per tick
+#define SCRIPT_WAVE_NAME_MAX 31         // LittleFS file name length
+
+// FNV-1a parameters used to fingerprint script sources
+#define SCRIPT_HASH_INIT 2166136261u
+#define SCRIPT_HASH_PRIME 16777619u
+
+/**
+ * @brief Parsed module program
+ */
+typedef struct {
+    test_operation_t* ops;       // Array of operations (heap allocated)
+    size_t count;                // Number of operations
+    test_alias_t* aliases;       // Alias table referenced by test_operation_t::alias (heap allocated)
+    size_t alias_count;          // Number of aliases
+    test_group_t* groups;        // Test groups in script order (heap allocated)
+    size_t group_count;          // Number of groups
+    bool retest_groups;          // A failed run is retried from the failed group
+    test_limits_t limits;        // Deadlines and retry backoff
+} script_program_t;
+
+/**
+ * @brief Severity of a script diagnostic
+ */
+typedef enum {
+    SCRIPT_DIAG_WARNING,         // Suspicious but the line was still used
+    SCRIPT_DIAG_ERROR            // The line is wrong, the op was skipped or will fail
+} script_diag_level_t;
+
+/**
+ * @brief Receives parser diagnostics, e.g. to collect them in a host tool
+ *
+ * @param ctx Context passed to script_parser_set_diag()
+ * @param level Severity
+ * @param line 1-based script line number
+ * @param message Diagnostic text
+ */
+typedef void (*script_diag_fn)(void* ctx, script_diag_level_t level, size_t line, const char* message);
+
+/**
+ * @brief Streaming parser state for module test scripts
+ *
+ * The parser consumes the script in arbitrary chunks (e.g. straight from a
+ * fixed file read buffer) and tokenizes complete lines in place. Only a line
+ * split across two chunks is copied into the carry buffer. Operations are
+ * appended to a heap array that grows geometrically, so a script costs
+ * O(log n) allocations regardless of its length.
+ *
+ * "# alias name=pin" lines build a symbol table. Alias names are accepted
+ * wherever a pin of the same kind is expected and are resolved to the pin
+ * number while parsing, so aliases cost nothing when the program runs.
+ * Aliases must be declared before the lines that use them.
+ *
+ * "# # name" section headers outside loops start test groups, which let a
+ * failed run be retried from the failed group instead of the first line.
+ */
+typedef struct {
+    test_operation_t* ops;       // Parsed operations (owned by the parser until taken)
+    size_t count;                // Number of parsed operations
+    size_t capacity;             // Allocated capacity of ops
+    test_alias_t* aliases;       // Declared aliases (owned by the parser until taken)
+    size_t alias_count;          // Number of declared aliases
+    size_t alias_capacity;       // Allocated capacity of aliases
+    test_group_t* groups;        // Groups from "# # name" headers (owned by the parser until taken)
+    size_t group_count;          // Number of groups
+    size_t group_capacity;       // Allocated capacity of groups
+    bool retest_groups;          // Set by a "# retest groups" line
+    test_limits_t limits;        // Set by "# deadline", "# timeout" and "# backoff" lines
+    size_t loop_stack[SCRIPT_LOOP_DEPTH_MAX]; // Indices of the open LOOP_START ops
+    size_t loop_depth;           // Number of open loops
+    bool unreachable;            // An infinite loop was closed, following ops never run
+    size_t line_number;          // Number of lines consumed so far
+    size_t allocations;          // Heap (re)allocations performed
+    bool out_of_memory;          // Set if growing ops failed
+    int scope_pin;               // Sink of the last scope op, or -1
+    int sweep_pin;               // Sink of the last sweep op, or -1
+    size_t errors;               // Number of error diagnostics
+    size_t warnings;             // Number of warning diagnostics
+    script_diag_fn diag;         // Diagnostic callback, nullptr to log them
+    void* diag_ctx;              // Context for diag
+    size_t carry_len;            // Bytes of a partial line held in carry
+    bool carry_overflow;         // Partial line did not fit into carry
+    char carry[SCRIPT_LINE_MAX]; // Partial line split across chunks
+} script_parser_t;
+
+/**
+ * @brief Initialize parser state
+ */
+void script_parser_init(script_parser_t* parser);
+
+/**
+ * @brief Route diagnostics to a callback instead of the log
+ *
+ * Call after script_parser_init().
+ */
+void script_parser_set_diag(script_parser_t* parser, script_diag_fn diag, void* ctx);
+
+/**
+ * @brief Feed the next chunk of script text
+ *
+ * @param parser Parser state
+ * @param data Chunk of script text, need not end on a line boundary
+ * @param len Chunk length in bytes
+ * @return false if the parser ran out of memory
+ */
+bool script_parser_feed(script_parser_t* parser, const char* data, size_t len);
+
+/**
+ * @brief Parse the trailing line (if any) and shrink ops to fit
+ *
+ * @return false if the parser ran out of memory
+ */
+bool script_parser_finish(script_parser_t* parser);
+
+/**
+ * @brief Move the parsed program out of the parser
+ *
+ * The caller must release program->ops and program->aliases with free().
+ */
+void script_parser_take_program(script_parser_t* parser, script_program_t* program);
+
+/**
+ * @brief Free any operations and aliases still owned by the parser
+ */
+void script_parser_release(script_parser_t* parser);
+
+/**
+ * @brief Update a FNV-1a hash of script source text
+ *
+ * @param hash Hash so far, SCRIPT_HASH_INIT for the first chunk
+ * @param data Chunk of script text
+ * @param len Chunk length in bytes
+ * @return Updated hash
+ */
+uint32_t script_hash_update(uint32_t hash, const char* data, size_t len);
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "board.h"
+#include "test_ops.h"
+
+/**
+ * @brief Argument layouts of script operations (see TEST_OPS)
+ */
+typedef enum {
+    SCRIPT_ARGS_NONE,          // <op>
+    SCRIPT_ARGS_VALUE,         // <op> <value>
+    SCRIPT_ARGS_SOURCE_VALUE,  // <op> <source> <value>
+    SCRIPT_ARGS_SOURCE_SIGNAL, // <op> <source> <freq> [shape] [amplitude] [offset] [duty]
+    SCRIPT_ARGS_SOURCE_WAVE,   // <op> <source> <file> <rate> [loop]
+    SCRIPT_ARGS_IO_STATE,      // <op> <io_pin> <h|l|z>
+    SCRIPT_ARGS_IO_LEVEL,      // <op> <io_pin> <h|l>
+    SCRIPT_ARGS_IO_PORT,       // <op> <first>-<last> <h|l|z|x per pin>
+    SCRIPT_ARGS_IO_LEVELS,     // <op> <first>-<last> <1|0|x per pin>
+    SCRIPT_ARGS_PD,            // <op> <ignored> <p|z>
+    SCRIPT_ARGS_RAIL_RANGE,    // <op> <rail> <low> <high>
+    SCRIPT_ARGS_SINK_RANGE,    // <op> <sink> <low> <high>
+    SCRIPT_ARGS_SINK_LIST,     // <op> <sink>:<low>:<high> ..., one operation per sink
+    SCRIPT_ARGS_SINK_SETTLE,   // <op> <sink> <tolerance> <timeout>
+    SCRIPT_ARGS_RAIL_SETTLE,   // <op> <rail> <tolerance> <timeout>
+    SCRIPT_ARGS_SOURCE_CAL,    // <op> <source> <sink> <max_error>
+    SCRIPT_ARGS_SWEEP,         // <op> <source> <sink> <f_start> <f_stop> <points>
+    SCRIPT_ARGS_LOOP_START,    // { [count|duration]
+    SCRIPT_ARGS_LOOP_END       // }
+} script_args_t;
+
+// X(sink, keyword): ADC sink names used in scripts, logs and results
+#define SCRIPT_SINKS(X) \
+    X(ADC_sink_1k_A, "A") \
+    X(ADC_sink_1k_B, "B") \
+    X(ADC_sink_1k_C, "C") \
+    X(ADC_sink_1k_D, "D") \
+    X(ADC_sink_1k_E, "E") \
+    X(ADC_sink_1k_F, "F") \
+    X(ADC_sink_PD_A, "pdA") \
+    X(ADC_sink_PD_B, "pdB") \
+    X(ADC_sink_PD_C, "pdC") \
+    X(ADC_sink_Z_D,  "zD") \
+    X(ADC_sink_Z_E,  "zE") \
+    X(ADC_sink_Z_F,  "zF")
+
+// X(source, keyword): voltage source names
+#define SCRIPT_SOURCES(X) \
+    X(SOURCE_A, "A") \
+    X(SOURCE_B, "B") \
+    X(SOURCE_C, "C") \
+    X(SOURCE_D, "D")
+
+// X(rail, keyword, name, ina_pin): current rails measured by the INA sensors
+#define SCRIPT_RAILS(X) \
+    X(CURRENT_RAIL_12V,  "+12", "+12V", PIN_INA_12V) \
+    X(CURRENT_RAIL_5V,   "+5",  "+5V",  PIN_INA_5V) \
+    X(CURRENT_RAIL_M12V, "-12", "-12V", PIN_INA_M12V)
+
+// Current rails, stored in test_operation_t::pin for CHECK_CURRENT
+#define CURRENT_RAIL_ENUM(rail, keyword, name, pin) rail,
+typedef enum {
+    SCRIPT_RAILS(CURRENT_RAIL_ENUM)
+    CURRENT_RAIL_COUNT
+} current_rail_t;
+#undef CURRENT_RAIL_ENUM
+
+// X(state, keyword): IO pin states
+#define SCRIPT_IO_STATES(X) \
+    X(IO_HIGH,  "h") \
+    X(IO_LOW,   "l") \
+    X(IO_INPUT, "z")
+
+// X(shape, keyword): signal generator waveforms
+#define SCRIPT_SIGNAL_SHAPES(X) \
+    X(SIGNAL_SINE,     "sine") \
+    X(SIGNAL_SQUARE,   "sq") \
+    X(SIGNAL_TRIANGLE, "tri") \
+    X(SIGNAL_SAW,      "saw") \
+    X(SIGNAL_PULSE,    "pulse")
+
+// Operation lookups: keyword -> op is a compile-time hash table, op -> strings is an array index
+bool script_lookup_op(const char* str, size_t len, test_op_type_t* op);
+script_args_t script_op_args(test_op_type_t op);
+const char* script_op_keyword(test_op_type_t op);
+const char* script_op_name(test_op_type_t op);
+
+// Control operations (loop markers) steer the interpreter and produce no result
+bool script_op_is_control(test_op_type_t op);
+
+// Checks that only measure and drive nothing, the operations a script may mark "&"
+bool script_op_is_check(test_op_type_t op);
+
+// Operations that run inside a pending delay window instead of waiting for it:
+// checks of the last sweep, which only read results the tester already holds,
+// and checks the script marked "&". Anything that could observe the module's
+// response to the actuations before the delay waits, as in sequential execution.
+bool script_op_runs_in_delay(const test_operation_t& op);
+
+// Pin lookups, the lookup functions return false for unknown names
+bool script_lookup_sink(const char* str, size_t len, ADC_sink_t* sink);
+const char* script_sink_name(ADC_sink_t sink);
+
+bool script_lookup_source(const char* str, size_t len, source_net_t* source);
+const char* script_source_name(source_net_t source);
+
+bool script_lookup_rail(const char* str, size_t len, current_rail_t* rail);
+const char* script_rail_name(current_rail_t rail);
+int script_rail_pin(current_rail_t rail);
+
+bool script_lookup_io_state(const char* str, size_t len, io_state_t* state);
+
+bool script_lookup_signal_shape(const char* str, size_t len, signal_shape_t* shape);
+const char* script_signal_shape_name(signal_shape_t shape);
\ No newline at end of file
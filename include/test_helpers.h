@@ -104,6 +104,28 @@ bool check_initial_current_consumption(const power_rails_current_ranges_t& range
  */
 bool test_pin_range(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result = nullptr);
 
+/**
+ * @brief Wait until a sink voltage stops moving
+ *
+ * Polls the pin every SETTLE_POLL_MS until the last SETTLE_WINDOW readings
+ * lie within the tolerance of each other, then returns at once. Replaces
+ * fixed delays sized for the slowest unit.
+ *
+ * @param pin The ADC sink pin to watch
+ * @param tolerance_mv Largest spread of the readings in the window, in millivolts
+ * @param timeout_ms Give up after this long and continue anyway, with a warning
+ * @param pin_name The name of the pin for display purposes
+ * @param result Output parameter for the last reading
+ */
+void settle_pin(ADC_sink_t pin, int32_t tolerance_mv, uint32_t timeout_ms, const char* pin_name, int32_t* result = nullptr);
+
+/**
+ * @brief Wait until a rail current stops moving, see settle_pin()
+ *
+ * @param tolerance_ua Largest spread of the readings in the window, in microamps
+ */
+void settle_current(ina_pin_t pin, int32_t tolerance_ua, uint32_t timeout_ms, const char* rail_name, int32_t* result = nullptr);
+
 /**
  * @brief Test a pin with pull-down functionality
  * 
@@ -136,16 +158,47 @@ bool test_mode(const int led_pin1, const int led_pin2, const mode_current_ranges
  */
 bool execute_reset_operation();
 
-// Helper function to map current measurement pin numbers from JSON to actual pins
+// Helper function to map current rails (current_rail_t) to actual INA pins
 int map_current_pin(int pin);
 
+// Time Sigscoper at every rate the loaded scripts capture at (scope, freq and
+// sweep), so checks work with the rate it really delivers. Rates already timed
+// are skipped; call between runs, it takes the ADC from the DMA engine.
+void measure_scope_rates();
+
 // Sigscoper functions
 bool start_sigscoper(ADC_sink_t pin, uint32_t sample_freq, size_t buffer_size);
-bool check_signal_min(ADC_sink_t pin, const range_t& range, int32_t* result = nullptr);
-bool check_signal_max(ADC_sink_t pin, const range_t& range, int32_t* result = nullptr);
-bool check_signal_avg(ADC_sink_t pin, const range_t& range, int32_t* result = nullptr);
-bool check_signal_freq(ADC_sink_t pin, const range_t& range, int32_t* result = nullptr);
-bool check_signal_amplitude(ADC_sink_t pin, const range_t& range, int32_t* result = nullptr);
+bool check_signal_min(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result = nullptr);
+bool check_signal_max(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result = nullptr);
+bool check_signal_avg(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result = nullptr);
+// Frequency by freq_estimate(); without a scope on the pin the check captures
+// on its own at a rate and length planned from the range
+bool check_signal_freq(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result = nullptr);
+bool check_signal_amplitude(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result = nullptr);
+
+/**
+ * @brief Step the signal generator over a band and measure the response on a sink
+ *
+ * Plays a SWEEP_AMPLITUDE_MV sine on the source at points log-spaced from
+ * start to stop (see freq_sweep.h), captures each with Sigscoper and takes
+ * the gain and phase of the stimulus frequency by Goertzel. The next point
+ * is started before the current one is computed, so the two overlap. The
+ * source is stopped at the end. Phase is referred to the generator at the
+ * start of the capture and includes the capture start latency, so it is
+ * logged but not checked.
+ *
+ * @param result Output parameter for the number of points measured
+ * @return true if every point was captured
+ */
+bool run_freq_sweep(source_net_t source, ADC_sink_t sink, int32_t start_mhz, int32_t stop_mhz, int points,
+                    const char* pin_name, int32_t* result = nullptr);
+
+// Checks of the last sweep on a sink, against the gain of its first point:
+// the -3 dB frequency in Hz, the roll-off beyond it in dB/decade and the
+// resonance peak in 0.1 dB
+bool check_sweep_cutoff(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result = nullptr);
+bool check_sweep_slope(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result = nullptr);
+bool check_sweep_peak(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result = nullptr);
 
 // Helper functions for ADC mapping
 adc_unit_t adc_sink_to_unit(ADC_sink_t pin);
@@ -155,10 +208,32 @@ adc_unit_t adc_sink_to_unit(ADC_sink_t pin);
  * 
  * @param pin The IO pin to check
  * @param expected_level Expected level (1 for HIGH, 0 for LOW)
+ * @param pin_name Name of the pin for display purposes
  * @param level_name Name of the expected level for display purposes
  * @param result Output parameter for actual level read
  * @return true if the level matches expected, false otherwise
  */
-bool check_io_level(mcp_io_t pin, int expected_level, const char* level_name, int32_t* result = nullptr);
+bool check_io_level(mcp_io_t pin, int expected_level, const char* pin_name, const char* level_name, int32_t* result = nullptr);
+
+/**
+ * @brief Check the levels of several IO pins from one port read
+ *
+ * @param mask IO pins to compare, bit n = IO n
+ * @param expected Expected levels of the pins in mask
+ * @param pin_name Name of the pin range for display purposes
+ * @param result Output parameter for the levels read, masked
+ * @return true if every pin in mask has its expected level
+ */
+bool check_io_levels(uint16_t mask, uint16_t expected, const char* pin_name, int32_t* result = nullptr);
+
+/**
+ * @brief Report whether the last check failed because a blocking wait timed out
+ *
+ * Signal checks wait for the scope capture for at most its nominal length
+ * plus a margin. The flag is cleared by this call.
+ *
+ * @return true if a wait gave up since the previous call
+ */
+bool take_wait_timeout();
 
  
\ No newline at end of file
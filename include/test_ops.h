@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Registry of script operations
+ *
+ * X(op, keyword, name, args): enum value, script keyword, name used in logs
+ * and results, and the argument layout the parser expects (script_args_t).
+ * Adding an operation means adding one entry here and a case to
+ * execute_single_operation().
+ */
+#define TEST_OPS(X) \
+    X(TEST_OP_SOURCE,          "src",       "SOURCE",          SCRIPT_ARGS_SOURCE_VALUE) /* Set voltage source */ \
+    X(TEST_OP_SOURCE_SIG,      "src_sig",   "SOURCE_SIG",      SCRIPT_ARGS_SOURCE_SIGNAL) /* Start signal generator */ \
+    X(TEST_OP_SOURCE_WAVE,     "src_wav",   "SOURCE_WAVE",     SCRIPT_ARGS_SOURCE_WAVE)  /* Play a sample file through the signal generator */ \
+    X(TEST_OP_IO,              "io",        "IO",              SCRIPT_ARGS_IO_STATE)     /* Set IO pin state */ \
+    X(TEST_OP_SINK_PD,         "pd",        "SINK_PD",         SCRIPT_ARGS_PD)           /* Set sink pulldown */ \
+    X(TEST_OP_CHECK_CURRENT,   "i",         "CHECK_CURRENT",   SCRIPT_ARGS_RAIL_RANGE)   /* Check current consumption */ \
+    X(TEST_OP_CHECK_PIN,       "v",         "CHECK_PIN",       SCRIPT_ARGS_SINK_RANGE)   /* Check pin voltage */ \
+    X(TEST_OP_CHECK_PIN_MULTI, "vmulti",    "CHECK_PIN_MULTI", SCRIPT_ARGS_SINK_LIST)    /* Check several pin voltages from one ADC sweep */ \
+    X(TEST_OP_RESET,           "reset",     "RESET",           SCRIPT_ARGS_NONE)         /* Reset all pins to safe state */ \
+    X(TEST_OP_SCOPE,           "scope",     "SCOPE",           SCRIPT_ARGS_SINK_RANGE)   /* Start Sigscoper in FREE mode */ \
+    X(TEST_OP_CHECK_MIN,       "min",       "CHECK_MIN",       SCRIPT_ARGS_SINK_RANGE)   /* Check minimum signal value */ \
+    X(TEST_OP_CHECK_MAX,       "max",       "CHECK_MAX",       SCRIPT_ARGS_SINK_RANGE)   /* Check maximum signal value */ \
+    X(TEST_OP_CHECK_AVG,       "avg",       "CHECK_AVG",       SCRIPT_ARGS_SINK_RANGE)   /* Check average signal value */ \
+    X(TEST_OP_CHECK_FREQ,      "freq",      "CHECK_FREQ",      SCRIPT_ARGS_SINK_RANGE)   /* Check signal frequency */ \
+    X(TEST_OP_CHECK_AMPLITUDE, "amplitude", "CHECK_AMPLITUDE", SCRIPT_ARGS_SINK_RANGE)   /* Check signal amplitude (max - min) */ \
+    X(TEST_OP_SWEEP,           "sweep",     "SWEEP",           SCRIPT_ARGS_SWEEP)        /* Step the generator over a band and measure gain and phase */ \
+    X(TEST_OP_CHECK_CUTOFF,    "cutoff",    "CHECK_CUTOFF",    SCRIPT_ARGS_SINK_RANGE)   /* Check the -3 dB frequency of the last sweep */ \
+    X(TEST_OP_CHECK_SLOPE,     "slope",     "CHECK_SLOPE",     SCRIPT_ARGS_SINK_RANGE)   /* Check the roll-off of the last sweep in dB/decade */ \
+    X(TEST_OP_CHECK_PEAK,      "peak",      "CHECK_PEAK",      SCRIPT_ARGS_SINK_RANGE)   /* Check the resonance peak of the last sweep in 0.1 dB */ \
+    X(TEST_OP_DELAY,           "delay",     "DELAY",           SCRIPT_ARGS_VALUE)        /* Delay for specified time in milliseconds */ \
+    X(TEST_OP_CHECK_IO_LEVEL,  "iolevel",   "CHECK_IO_LEVEL",  SCRIPT_ARGS_IO_LEVEL)     /* Check IO pin level */ \
+    X(TEST_OP_IO_PORT,         "ioport",    "IO_PORT",         SCRIPT_ARGS_IO_PORT)      /* Set several IO pins in one step */ \
+    X(TEST_OP_CHECK_IO_LEVELS, "iolevels",  "CHECK_IO_LEVELS", SCRIPT_ARGS_IO_LEVELS)    /* Check several IO pin levels from one port read */ \
+    X(TEST_OP_SETTLE,          "settle",    "SETTLE",          SCRIPT_ARGS_SINK_SETTLE)  /* Wait until a sink voltage stops moving */ \
+    X(TEST_OP_SETTLE_CURRENT,  "isettle",   "SETTLE_CURRENT",  SCRIPT_ARGS_RAIL_SETTLE)  /* Wait until a rail current stops moving */ \
+    X(TEST_OP_CALIBRATE_SOURCE, "calsrc",   "CALIBRATE_SOURCE", SCRIPT_ARGS_SOURCE_CAL)  /* Calibrate a voltage source through a loopback to a sink */ \
+    X(TEST_OP_LOOP_START,      "{",         "LOOP_START",      SCRIPT_ARGS_LOOP_START)   /* Loop start, optional count or duration */ \
+    X(TEST_OP_LOOP_END,        "}",         "LOOP_END",        SCRIPT_ARGS_LOOP_END)     /* Loop end */
+
+// Test operation types
+#define TEST_OP_ENUM(op, keyword, name, args) op,
+typedef enum {
+    TEST_OPS(TEST_OP_ENUM)
+    TEST_OP_COUNT
+} test_op_type_t;
+#undef TEST_OP_ENUM
+
+// Longest alias name, including the terminating NUL
+#define TEST_ALIAS_NAME_MAX 24
+
+// Kind of pin an alias names, matching the argument it may replace
+typedef enum {
+    ALIAS_PIN_SOURCE,     // "out A".."out D", voltage sources
+    ALIAS_PIN_SINK,       // "in A".."in zF", ADC sinks
+    ALIAS_PIN_IO          // "0".."15", MCP23017 IO pins
+} alias_pin_kind_t;
+
+// Alias declared by a "# alias name=pin" line
+typedef struct {
+    char name[TEST_ALIAS_NAME_MAX];
+    uint8_t kind;         // alias_pin_kind_t
+    int16_t pin;          // Source, sink or IO pin number
+} test_alias_t;
+
+// Longest test group name, including the terminating NUL
+#define TEST_GROUP_NAME_MAX 32
+
+// Test group started by a "# # name" section header
+typedef struct {
+    char name[TEST_GROUP_NAME_MAX];
+    uint16_t first_op;    // Index of the first operation of the group
+    uint16_t end_op;      // Index one past the last operation of the group
+} test_group_t;
+
+// Test operation structure
+typedef struct {
+    bool repeat;           // Use TEST_RUN_REPEAT if true, TEST_RUN if false
+    bool overlap;          // Marked "&": a check the script allows to run inside a pending delay window
+    int16_t alias;         // Index of the alias naming pin, or -1
+    test_op_type_t op;    // Operation type
+    int pin;              // Pin number, index of the matching loop marker for LOOP_START/LOOP_END
+    int32_t arg1;         // Voltage for SOURCE, frequency in mHz for SOURCE_SIG, file name hash for SOURCE_WAVE, state for IO, 0/1 for SINK_PD, low value for checks, tolerance for SETTLE, iterations for LOOP_START,
+                          // loopback sink for CALIBRATE_SOURCE, sink and points for SWEEP packed by SWEEP_ARG1(),
+                          // levels for IO_PORT/CHECK_IO_LEVELS (bit n = IO n)
+    int32_t arg2;         // High value for checks, sample rate for SOURCE_WAVE, timeout in ms for SETTLE, duration in ms for LOOP_START, largest fit error in mV for CALIBRATE_SOURCE,
+                          // IO_PORT/CHECK_IO_LEVELS: pins affected in the low 16 bits, IO_PORT inputs in the high 16 bits,
+                          // SOURCE_SIG: waveform packed by SIGNAL_ARG2(), start frequency in mHz for SWEEP
+    int32_t arg3;         // Offset in mV for SOURCE_SIG, 1 to loop SOURCE_WAVE, stop frequency in mHz for SWEEP
+    uint32_t timeout_ms;  // Retry deadline of a repeat op ("+2s"), 0 uses the script default
+} test_operation_t;
+
+// SOURCE_SIG waveform in arg2: amplitude in mV (bits 0..15), duty cycle in % (16..23), signal_shape_t (24..31)
+#define SIGNAL_ARG2(shape, amplitude_mv, duty) \
+    ((int32_t)(((uint32_t)(shape) << 24) | ((uint32_t)(duty) << 16) | ((uint32_t)(amplitude_mv) & 0xFFFF)))
+#define SIGNAL_ARG2_SHAPE(arg2) (((uint32_t)(arg2) >> 24) & 0xFF)
+#define SIGNAL_ARG2_DUTY(arg2) (((uint32_t)(arg2) >> 16) & 0xFF)
+#define SIGNAL_ARG2_AMPLITUDE(arg2) ((uint32_t)(arg2) & 0xFFFF)
+
+// SWEEP sink and point count in arg1: ADC_sink_t (bits 0..7), points (8..15)
+#define SWEEP_ARG1(sink, points) ((int32_t)(((uint32_t)(points) << 8) | ((uint32_t)(sink) & 0xFF)))
+#define SWEEP_ARG1_SINK(arg1) ((uint32_t)(arg1) & 0xFF)
+#define SWEEP_ARG1_POINTS(arg1) (((uint32_t)(arg1) >> 8) & 0xFF)
+
+// Script-wide limits set by "# deadline", "# timeout" and "# backoff" lines
+typedef struct {
+    uint32_t deadline_ms;       // Whole script, 0 for no limit
+    uint32_t retry_timeout_ms;  // Default retry deadline of repeat ops, 0 retries until the module is removed
+    uint32_t backoff_ms;        // Delay before the first retry
+    uint32_t backoff_max_ms;    // Retry delay doubles up to this value
+} test_limits_t;
+
+// Outcome of an operation, TEST_STATUS_NONE until it has run
+#define TEST_STATUSES(X) \
+    X(TEST_STATUS_NONE,    "none")    \
+    X(TEST_STATUS_OK,      "ok")      \
+    X(TEST_STATUS_FAIL,    "fail")    \
+    X(TEST_STATUS_TIMEOUT, "timeout")
+
+#define TEST_STATUS_ENUM(status, name) status,
+typedef enum {
+    TEST_STATUSES(TEST_STATUS_ENUM)
+} test_status_t;
+#undef TEST_STATUS_ENUM
+
+// Test result structure
+typedef struct {
+    bool passed;          // true if test passed, false if failed
+    uint8_t status;       // test_status_t, tells a timeout from an out-of-range failure
+    int32_t result;       // actual value obtained from the operation (if test failed)
+    uint32_t execution_time_ms; // execution time in milliseconds
+} test_operation_result_t;
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+#include "board.h"
+
+// Arbitrary waveforms for the signal generator: sample files in WAVE_DIR hold
+// little-endian int16 millivolts, one per sample, and are played at a rate set
+// by the script. A file that fits the pool is loaded once and stays resident
+// for later runs; longer files stream from LittleFS through two blocks per
+// source, refilled by a loader task while the other block plays.
+//
+// Files are named in scripts by the FNV-1a hash of their name (see
+// script_hash_update()), so operations need no string storage.
+
+#define WAVE_DIR           "/waves"
+#define WAVE_POOL_SAMPLES  16384   // Resident samples of all files, 32 KB
+#define WAVE_POOL_FILES    8
+#define WAVE_STREAM_BLOCK  512     // Samples per streaming block, 25 ms at 20 kHz
+
+// Find the file by its name hash and prepare it for playback on a source,
+// closing whatever the source played before. False when the file is missing,
+// empty or has an odd size.
+bool wave_open(source_net_t net, uint32_t name_hash, bool loop);
+// Stop playback on a source and release its stream
+void wave_close(source_net_t net);
+// Advance a source by steps samples and return the current one in mV; a wave
+// played once holds its last sample. Called by the generator task every tick,
+// never blocks: a stream that is not refilled in time holds its sample too.
+int32_t wave_advance(source_net_t net, uint32_t steps);
+// Name of the file a source plays, for logs
+const char* wave_name(source_net_t net);
+// Drop resident copies once no source plays them, call after a file changed
+void wave_invalidate();
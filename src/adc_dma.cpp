@@ -0,0 +1,258 @@
+#include "adc_dma.h"
+#include "hal.h"
+#include "esp_log.h"
+#include <algorithm>
+#include <esp_adc/adc_continuous.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static const char* TAG = "adc_dma";
+
+#define ADC_DMA_FRAME_RESULTS 64   // Conversions per DMA frame, one callback each
+#define ADC_DMA_FRAME_BYTES   (ADC_DMA_FRAME_RESULTS * SOC_ADC_DIGI_RESULT_BYTES)
+#define ADC_DMA_PERIOD_NS     (1000000000UL / ADC_DMA_SAMPLE_FREQ_HZ)
+#define ADC_DMA_WAIT_MS       5    // A read gives up after this long without fresh samples
+#define ADC_DMA_CHANNELS      10   // ADC1 channel numbers
+
+typedef struct {
+    uint16_t raw[ADC_DMA_RING_SIZE];
+    uint8_t head;           // Next slot to write
+    uint8_t fresh;          // Samples taken after the last stimulus, saturates at the ring size
+    uint32_t timestamp_us;  // Time of the newest sample
+} adc_ring_t;
+
+static adc_continuous_handle_t adc_handle = NULL;
+static portMUX_TYPE adc_lock = portMUX_INITIALIZER_UNLOCKED;
+static adc_ring_t rings[ADC_sink_count];
+static int8_t channel_sink[ADC_DMA_CHANNELS];  // ADC1 channel -> sink, -1 when not converted
+static bool sink_covered[ADC_sink_count];
+static volatile uint32_t stimulus_us = 0;
+static TaskHandle_t waiter = NULL;             // Task blocked in adc_dma_read(), woken per frame
+static bool adc1_taken = false;                // Another continuous user (Sigscoper) holds ADC1
+
+// Runs from the DMA interrupt for every finished frame. The frame ends now and
+// its conversions are ADC_DMA_PERIOD_NS apart, which dates each sample.
+// Integer math only, the FPU is not available in interrupts.
+static bool IRAM_ATTR adc_dma_on_frame(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* edata, void* user_data) {
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    size_t results = edata->size / SOC_ADC_DIGI_RESULT_BYTES;
+    BaseType_t woken = pdFALSE;
+
+    portENTER_CRITICAL_ISR(&adc_lock);
+    for (size_t k = 0; k < results; k++) {
+        const adc_digi_output_data_t* p = (const adc_digi_output_data_t*)&edata->conv_frame_buffer[k * SOC_ADC_DIGI_RESULT_BYTES];
+        uint8_t channel = p->type1.channel;
+        if (channel >= ADC_DMA_CHANNELS || channel_sink[channel] < 0) {
+            continue;
+        }
+        adc_ring_t& ring = rings[channel_sink[channel]];
+        uint32_t taken = now - (results - 1 - k) * ADC_DMA_PERIOD_NS / 1000;
+        ring.raw[ring.head] = p->type1.data;
+        ring.head = (ring.head + 1) & (ADC_DMA_RING_SIZE - 1);
+        ring.timestamp_us = taken;
+        if ((int32_t)(taken - stimulus_us) > 0 && ring.fresh < ADC_DMA_RING_SIZE) {
+            ring.fresh++;
+        }
+    }
+    if (waiter) {
+        vTaskNotifyGiveFromISR(waiter, &woken);
+    }
+    portEXIT_CRITICAL_ISR(&adc_lock);
+
+    return woken == pdTRUE;
+}
+
+bool adc_dma_start() {
+    if (adc_handle) {
+        return true;
+    }
+
+    // Map the sinks that sit on ADC1 to their channels
+    adc_digi_pattern_config_t pattern[ADC_sink_count];
+    uint32_t pattern_num = 0;
+    std::fill(channel_sink, channel_sink + ADC_DMA_CHANNELS, -1);
+    for (int idx = 0; idx < ADC_sink_count; idx++) {
+        adc_unit_t unit;
+        adc_channel_t channel;
+        sink_covered[idx] = false;
+        if (adc_continuous_io_to_channel(ADC_PINS[idx], &unit, &channel) != ESP_OK || unit != ADC_UNIT_1 ||
+            channel >= ADC_DMA_CHANNELS) {
+            continue;
+        }
+        pattern[pattern_num].atten = ADC_ATTEN_DB_12;  // analogRead() default, keeps the calibration valid
+        pattern[pattern_num].channel = channel;
+        pattern[pattern_num].unit = ADC_UNIT_1;
+        pattern[pattern_num].bit_width = ADC_BITWIDTH_12;
+        pattern_num++;
+        channel_sink[channel] = idx;
+    }
+    if (pattern_num == 0) {
+        ESP_LOGW(TAG, "No ADC1 sinks to convert");
+        return false;
+    }
+
+    // Samples are taken from the frame callback, the driver's pool is never read
+    // and only needs the minimum size
+    adc_continuous_handle_cfg_t handle_cfg = {};
+    handle_cfg.max_store_buf_size = ADC_DMA_FRAME_BYTES * 2;
+    handle_cfg.conv_frame_size = ADC_DMA_FRAME_BYTES;
+    esp_err_t err = adc_continuous_new_handle(&handle_cfg, &adc_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create ADC handle: %s", esp_err_to_name(err));
+        adc_handle = NULL;
+        // Only one continuous driver exists at a time, ADC1 is still in use
+        if (err == ESP_ERR_INVALID_STATE) {
+            adc1_taken = true;
+        }
+        return false;
+    }
+    adc1_taken = false;
+
+    adc_continuous_config_t config = {};
+    config.pattern_num = pattern_num;
+    config.adc_pattern = pattern;
+    config.sample_freq_hz = ADC_DMA_SAMPLE_FREQ_HZ;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+
+    adc_continuous_evt_cbs_t callbacks = {};
+    callbacks.on_conv_done = adc_dma_on_frame;
+
+    portENTER_CRITICAL(&adc_lock);
+    for (int idx = 0; idx < ADC_sink_count; idx++) {
+        rings[idx].head = 0;
+        rings[idx].fresh = 0;
+    }
+    stimulus_us = (uint32_t)esp_timer_get_time();
+    portEXIT_CRITICAL(&adc_lock);
+
+    err = adc_continuous_config(adc_handle, &config);
+    if (err == ESP_OK) {
+        err = adc_continuous_register_event_callbacks(adc_handle, &callbacks, NULL);
+    }
+    if (err == ESP_OK) {
+        err = adc_continuous_start(adc_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start ADC conversion: %s", esp_err_to_name(err));
+        adc_continuous_deinit(adc_handle);
+        adc_handle = NULL;
+        return false;
+    }
+
+    for (int channel = 0; channel < ADC_DMA_CHANNELS; channel++) {
+        if (channel_sink[channel] >= 0) {
+            sink_covered[channel_sink[channel]] = true;
+        }
+    }
+
+    ESP_LOGI(TAG, "Converting %lu ADC1 sinks at %d Hz", pattern_num, ADC_DMA_SAMPLE_FREQ_HZ);
+    return true;
+}
+
+static void adc_dma_halt() {
+    if (!adc_handle) {
+        return;
+    }
+    adc_continuous_stop(adc_handle);
+    adc_continuous_deinit(adc_handle);
+    adc_handle = NULL;
+    ESP_LOGD(TAG, "ADC conversion stopped");
+}
+
+void adc_dma_stop(bool taken) {
+    adc_dma_halt();
+    adc1_taken = taken;
+}
+
+bool adc_dma_covers(ADC_sink_t sink) {
+    return adc_handle && sink < ADC_sink_count && sink_covered[sink];
+}
+
+void adc_dma_mark_stimulus() {
+    if (!adc_handle) {
+        return;
+    }
+    portENTER_CRITICAL(&adc_lock);
+    stimulus_us = (uint32_t)esp_timer_get_time();
+    for (int idx = 0; idx < ADC_sink_count; idx++) {
+        rings[idx].fresh = 0;
+    }
+    portEXIT_CRITICAL(&adc_lock);
+}
+
+bool adc_dma_read(ADC_sink_t sink, size_t count, adc_dma_value_t* value) {
+    if (!adc_dma_covers(sink) || count == 0) {
+        return false;
+    }
+    count = std::min(count, (size_t)ADC_DMA_RING_SIZE);
+
+    int samples[ADC_DMA_RING_SIZE];
+    uint32_t timestamp_us = 0;
+    bool ready = false;
+
+    // Each finished frame wakes the waiting task, so the CPU is free until
+    // enough samples taken after the last stimulus are in the ring
+    while (true) {
+        portENTER_CRITICAL(&adc_lock);
+        const adc_ring_t& ring = rings[sink];
+        ready = ring.fresh >= count;
+        if (ready) {
+            for (size_t k = 0; k < count; k++) {
+                samples[k] = ring.raw[(ring.head - 1 - k) & (ADC_DMA_RING_SIZE - 1)];
+            }
+            timestamp_us = ring.timestamp_us;
+            waiter = NULL;
+        } else {
+            waiter = xTaskGetCurrentTaskHandle();
+        }
+        portEXIT_CRITICAL(&adc_lock);
+
+        if (ready || ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ADC_DMA_WAIT_MS)) == 0) {
+            break;
+        }
+    }
+
+    if (!ready) {
+        portENTER_CRITICAL(&adc_lock);
+        waiter = NULL;
+        portEXIT_CRITICAL(&adc_lock);
+        ESP_LOGW(TAG, "No fresh samples for sink %d", sink);
+        return false;
+    }
+
+    int32_t sum = 0;
+    for (size_t k = 0; k < count; k++) {
+        sum += samples[k];
+    }
+    value->median = get_median(samples, (int)count);
+    value->mean = sum / (int32_t)count;
+    value->timestamp_us = timestamp_us;
+    return true;
+}
+
+bool adc_dma_oneshot_begin(ADC_sink_t sink, bool* resume) {
+    *resume = false;
+    adc_unit_t unit;
+    adc_channel_t channel;
+    if (sink >= ADC_sink_count || adc_continuous_io_to_channel(ADC_PINS[sink], &unit, &channel) != ESP_OK ||
+        unit != ADC_UNIT_1) {
+        return true;
+    }
+    if (adc1_taken) {
+        ESP_LOGE(TAG, "ADC1 is held by another continuous user, sink %d cannot be sampled", sink);
+        return false;
+    }
+    if (adc_handle) {
+        adc_dma_halt();
+        *resume = true;
+    }
+    return true;
+}
+
+void adc_dma_oneshot_end(bool resume) {
+    if (resume && !adc_dma_start()) {
+        ESP_LOGW(TAG, "ADC DMA engine did not restart, sinks are sampled on demand");
+    }
+}
@@ -1,9 +1,18 @@
 #include "hal.h"
+#include "adc_dma.h"
+#include "median.h"
+#include "wave_player.h"
 #include "esp_log.h"
 #include <SPI.h>
 #include <DAC8552.h>
 #include <algorithm>
 #include <math.h>
+#include <time.h>
+#include <LittleFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
 
 static const char* TAG = "hal";
 
@@ -12,15 +21,40 @@ SPIClass SPI_DAC(HSPI);
 DAC8552 dac1(PIN_CS1, &SPI_DAC);
 DAC8552 dac2(PIN_CS2, &SPI_DAC);
 Micro_MCP23X17 mcp0;  // addr 0x20
-Adafruit_MCP23X17 mcp1;  // addr 0x21
-
-// Signal generator arrays
-static IRAM_ATTR uint32_t signal_frequencies[SOURCE_COUNT] = {0, 0, 0, 0};
-static bool signal_generator_active[SOURCE_COUNT] = {false, false, false, false};
-static uint32_t signal_phase[SOURCE_COUNT] = {0, 0, 0, 0};
-
-// Sine wave lookup table (256 points for one period)
-static uint16_t sine_table[256];
+Micro_MCP23X17 mcp1;  // addr 0x21
+
+// Signal generator: the timer interrupt only advances the 32-bit phase accumulators
+// and wakes signal_task, which computes the sample of each source from its phase
+#define SIGNAL_SAMPLE_RATE_HZ 20000
+#define SIGNAL_TABLE_BITS 8          // Sine table indexed by the top 8 phase bits, the next 16 interpolate
+#define SIGNAL_TABLE_SIZE (1 << SIGNAL_TABLE_BITS)
+#define SIGNAL_AMPLITUDE_MV 2500
+#define SIGNAL_FULL_SCALE 32767      // Shape levels are Q15
+#define SIGNAL_TASK_PRIORITY 5       // Above the test loop (1) and the rail monitor (2)
+
+static volatile uint32_t signal_increment[SOURCE_COUNT] = {0, 0, 0, 0};  // Phase step per sample, 0 when stopped
+static volatile uint32_t signal_phase[SOURCE_COUNT] = {0, 0, 0, 0};
+
+/**
+ * @brief Waveform of a running source, written only while its increment is 0
+ */
+typedef struct {
+    signal_shape_t shape;
+    int32_t amplitude_mv;
+    int32_t offset_mv;
+    uint32_t duty_phase;  // Phase at which square and pulse go low
+    bool wave;            // Sample file instead of a shape, the phase counts samples in Q16
+    uint32_t wave_last;   // Phase of the previous tick
+    uint32_t wave_frac;   // Sample fraction carried over, Q16
+} signal_config_t;
+
+static signal_config_t signal_config[SOURCE_COUNT];
+
+// One sine period in Q15, the extra point saves a wrap when interpolating the last step
+static int16_t sine_table[SIGNAL_TABLE_SIZE + 1];
+
+static TaskHandle_t signal_task_handle = NULL;
+static SemaphoreHandle_t dac_mutex = NULL;  // One DAC transfer at a time, test loop or signal_task
 
 // Timer for signal generation
 static hw_timer_t* signal_timer = NULL;
@@ -37,53 +71,93 @@ static int32_t ref_adc_values[ADC_sink_count] = {0};
 // Median filter buffer size
 #define MEDIAN_FILTER_SIZE 15
 
+// Voltage sources: DAC codes at SOURCE_LUT_STEP_MV steps over the DAC8552 output
+// span, interpolated by hal_set_source(). Ideal codes until a source is calibrated.
+#define SOURCE_MV_MIN -5000
+#define SOURCE_MV_MAX 5000
+#define SOURCE_LUT_STEP_MV 1000
+#define SOURCE_LUT_POINTS ((SOURCE_MV_MAX - SOURCE_MV_MIN) / SOURCE_LUT_STEP_MV + 1)
+#define SOURCE_CAL_PATH "/source_calibration"
+#define SOURCE_CAL_MAGIC 0x4C414353u      // "SCAL"
+#define SOURCE_CAL_VERSION 1              // Bump whenever source_calibration_file_t changes
+#define SOURCE_CAL_POINTS 9               // Codes stepped through, at the ideal -4 V..+4 V
+#define SOURCE_CAL_READS 8                // Sink medians averaged per point
+#define SOURCE_CAL_SETTLE_MS 5
+#define SOURCE_CAL_GAIN_TOLERANCE 0.1     // Fitted gain within 10 % of the ideal one, or the loopback is missing
+
+static uint16_t source_lut[SOURCE_COUNT][SOURCE_LUT_POINTS];
+static uint8_t source_calibrated = 0;   // Bit per source_net_t
+
+// Stored calibration, reused across boots while it matches a quick measurement
+#define CALIB_PATH "/calibration"
+#define CALIB_MAGIC 0x424C4143u           // "CALB"
+#define CALIB_VERSION 1                   // Bump whenever calibration_file_t changes
+#define CALIB_MAX_BOOTS 200               // Full calibration again after this many reuses
+#define CALIB_CURRENT_TOLERANCE_UA 400    // About ten ADC counts of the INA196 output
+#define CALIB_ADC_TOLERANCE 16            // Raw ADC counts
+
+// Power rail monitor
+#define RAILS_DEBOUNCE_MS 5      // PASS levels must hold this long before they are published
+#define RAILS_POLL_MS 10         // Poll period without the MCP1 interrupt line
+#define RAILS_IDLE_MS 1000       // Safety-net poll with the interrupt line, in case an edge is missed
+#define RAILS_EVENT_ALL  (1 << 0)
+#define RAILS_EVENT_NONE (1 << 1)
+
+static TaskHandle_t rails_task_handle = NULL;
+static EventGroupHandle_t rails_events = NULL;
+static volatile uint8_t rails_bits = 0;  // Published RAILS_BIT_* state, a byte store is atomic
+
 // Initialize sine wave lookup table
 void init_sine_table() {
-    for (int i = 0; i < 256; i++) {
-        float angle = 2.0f * M_PI * i / 256.0f;
-        float sine = sinf(angle);
-        
-        // Convert to voltage: -2.5V to +2.5V
-        float voltage = 2.5f * sine;
-        
-        // Convert voltage to DAC value: -5V = 0, 0V = 32768, +5V = 65535
-        uint16_t dac_value = (uint16_t)((voltage + 5.0f) * 65535.0f / 10.0f);
-        
-        sine_table[i] = dac_value;
+    for (int i = 0; i < SIGNAL_TABLE_SIZE; i++) {
+        float angle = 2.0f * M_PI * i / SIGNAL_TABLE_SIZE;
+        sine_table[i] = (int16_t)lroundf(SIGNAL_FULL_SCALE * sinf(angle));
     }
+    sine_table[SIGNAL_TABLE_SIZE] = sine_table[0];
 }
 
-// Signal generator callback function
-void IRAM_ATTR signal_generator_callback() {
-    for (int i = 0; i < SOURCE_COUNT; i++) {
-        if (signal_frequencies[i] > 0) {
-            // Get DAC value from sine table
-            uint16_t dac_value = sine_table[(signal_phase[i] / 128) & 0xFF];
-            
-            // Set DAC value directly
-            hal_set_source_direct((source_net_t)i, dac_value);
-            
-            signal_generator_active[i] = true;
-        } else {
-            signal_generator_active[i] = false;
+// Shape level at a phase in Q15. Triangle and saw are shifted to start at 0
+// rising like the sine, so every shape begins mid-scale.
+static int32_t signal_level(const signal_config_t& config, uint32_t phase) {
+    switch (config.shape) {
+        case SIGNAL_SQUARE:
+            return phase < config.duty_phase ? SIGNAL_FULL_SCALE : -SIGNAL_FULL_SCALE;
+        case SIGNAL_PULSE:
+            return phase < config.duty_phase ? SIGNAL_FULL_SCALE : 0;
+        case SIGNAL_TRIANGLE: {
+            int32_t x = (phase + 0x40000000u) >> 15;  // 0..131071
+            return x < 65536 ? x - 32768 : 98303 - x;
+        }
+        case SIGNAL_SAW:
+            return (int32_t)((phase + 0x80000000u) >> 16) - 32768;
+        case SIGNAL_SINE:
+        default: {
+            uint32_t i = phase >> (32 - SIGNAL_TABLE_BITS);
+            int32_t frac = (phase >> (16 - SIGNAL_TABLE_BITS)) & 0xFFFF;
+            int32_t a = sine_table[i];
+            return a + (((sine_table[i + 1] - a) * frac) >> 16);
         }
     }
-    
-    // Increment table index for next sample
+}
+
+// Signal generator timer interrupt: advance the phases and hand the sample to signal_task
+void IRAM_ATTR signal_generator_callback() {
     for (int i = 0; i < SOURCE_COUNT; i++) {
-        signal_phase[i] += signal_frequencies[i];
+        signal_phase[i] += signal_increment[i];
     }
-}
 
-// Direct source setting function with DAC value
-void hal_set_source_direct(source_net_t net, uint16_t dac_value) {
-    // Validate net
-    if (net >= SOURCE_COUNT) {
-        ESP_LOGE(TAG, "Invalid source net: %d", net);
+    if (!signal_task_handle) {
         return;
     }
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(signal_task_handle, &woken);
+    if (woken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
 
-    // Set appropriate DAC based on net
+// Write one DAC channel, the caller holds dac_mutex
+static void write_source_dac(source_net_t net, uint16_t dac_value) {
     switch (net) {
         case SOURCE_A:
             dac2.setValue(0, dac_value);  // DAC1 channel A
@@ -98,12 +172,197 @@ void hal_set_source_direct(source_net_t net, uint16_t dac_value) {
             dac1.setValue(1, dac_value);  // DAC1 channel B
             break;
         default:
-            return;  // Should never reach here due to validation above
+            break;
+    }
+}
+
+static uint16_t source_code(source_net_t net, int32_t voltage_mv);
+
+// Writes the current sample of every running source. Ticks that arrive while a
+// write is in progress are dropped; the phases have already moved on, so the
+// waveform keeps its frequency.
+static void signal_task(void* parameter) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        xSemaphoreTake(dac_mutex, portMAX_DELAY);
+        for (int i = 0; i < SOURCE_COUNT; i++) {
+            if (signal_increment[i]) {
+                signal_config_t& config = signal_config[i];
+                int32_t mv;
+                if (config.wave) {
+                    uint32_t phase = signal_phase[i];
+                    uint32_t moved = config.wave_frac + (phase - config.wave_last);
+                    config.wave_last = phase;
+                    config.wave_frac = moved & 0xFFFF;
+                    mv = wave_advance((source_net_t)i, moved >> 16);
+                } else {
+                    mv = config.offset_mv + ((config.amplitude_mv * signal_level(config, signal_phase[i])) >> 15);
+                }
+                write_source_dac((source_net_t)i, source_code((source_net_t)i, mv));
+            }
+        }
+        xSemaphoreGive(dac_mutex);
+    }
+}
+
+// Run the timer only while a generator is on
+static void update_signal_timer() {
+    bool active = false;
+    for (int i = 0; i < SOURCE_COUNT; i++) {
+        active |= signal_increment[i] != 0;
+    }
+    if (active && !signal_timer_running) {
+        timerStart(signal_timer);
+    } else if (!active && signal_timer_running) {
+        timerStop(signal_timer);
+    }
+    signal_timer_running = active;
+}
+
+// Direct source setting function with DAC value, stops a generator on the source
+void hal_set_source_direct(source_net_t net, uint16_t dac_value) {
+    // Validate net
+    if (net >= SOURCE_COUNT) {
+        ESP_LOGE(TAG, "Invalid source net: %d", net);
+        return;
+    }
+
+    if (signal_increment[net]) {
+        signal_increment[net] = 0;
+        update_signal_timer();
+    }
+
+    xSemaphoreTake(dac_mutex, portMAX_DELAY);
+    write_source_dac(net, dac_value);
+    bool was_wave = signal_config[net].wave;
+    signal_config[net].wave = false;
+    xSemaphoreGive(dac_mutex);
+    adc_dma_mark_stimulus();
+    if (was_wave) {
+        wave_close(net);
     }
 
     ESP_LOGD(TAG, "Set source %d to DAC value: %d", net, dac_value);
 }
 
+// DAC code of the ideal output stage: -5 V = 0, 0 V = 32768, +5 V = 65535
+static int32_t source_ideal_code(int32_t voltage_mv) {
+    return (int32_t)(((int64_t)(voltage_mv - SOURCE_MV_MIN) * 65535) / (SOURCE_MV_MAX - SOURCE_MV_MIN));
+}
+
+static void source_lut_ideal(source_net_t net) {
+    for (int k = 0; k < SOURCE_LUT_POINTS; k++) {
+        source_lut[net][k] = (uint16_t)source_ideal_code(SOURCE_MV_MIN + k * SOURCE_LUT_STEP_MV);
+    }
+    source_calibrated &= ~(1 << net);
+}
+
+// DAC code of a voltage, integer interpolation between the two LUT points around it
+static uint16_t source_code(source_net_t net, int32_t voltage_mv) {
+    voltage_mv = constrain(voltage_mv, SOURCE_MV_MIN, SOURCE_MV_MAX);
+    int32_t offset = voltage_mv - SOURCE_MV_MIN;
+    int k = min((int)(offset / SOURCE_LUT_STEP_MV), SOURCE_LUT_POINTS - 2);
+    int32_t frac = offset - k * SOURCE_LUT_STEP_MV;
+    const uint16_t* lut = source_lut[net];
+    int32_t code = lut[k] + ((int32_t)lut[k + 1] - (int32_t)lut[k]) * frac / SOURCE_LUT_STEP_MV;
+    return (uint16_t)constrain(code, (int32_t)0, (int32_t)65535);
+}
+
+void hal_set_source(source_net_t net, int32_t voltage_mv) {
+    if (net >= SOURCE_COUNT) {
+        ESP_LOGE(TAG, "Invalid source net: %d", net);
+        return;
+    }
+    hal_set_source_direct(net, source_code(net, voltage_mv));
+}
+
+void hal_start_signal(source_net_t net, double freq, const signal_wave_t* wave) {
+    static const signal_wave_t default_wave = {SIGNAL_SINE, SIGNAL_AMPLITUDE_MV, 0, 50};
+    if (!wave) {
+        wave = &default_wave;
+    }
+    if (net >= SOURCE_COUNT) {
+        ESP_LOGE(TAG, "Invalid source net: %d", net);
+        return;
+    }
+    if (freq <= 0 || freq >= SIGNAL_SAMPLE_RATE_HZ / 2 || wave->shape >= SIGNAL_SHAPE_COUNT) {
+        ESP_LOGE(TAG, "Signal shape %d at %.3f Hz not supported, frequency must be within 0..%d Hz",
+                 wave->shape, freq, SIGNAL_SAMPLE_RATE_HZ / 2);
+        hal_stop_signal(net);
+        return;
+    }
+
+    // Samples go through source_code() as they are generated, so signals get
+    // the source calibration too
+    signal_increment[net] = 0;
+    xSemaphoreTake(dac_mutex, portMAX_DELAY);
+    signal_config_t& config = signal_config[net];
+    config.shape = wave->shape;
+    config.amplitude_mv = constrain(wave->amplitude_mv, (int32_t)0, (int32_t)SOURCE_MV_MAX);
+    config.offset_mv = constrain(wave->offset_mv, (int32_t)SOURCE_MV_MIN, (int32_t)SOURCE_MV_MAX);
+    config.duty_phase = (uint32_t)(((uint64_t)constrain((int)wave->duty, 1, 99) << 32) / 100);
+    bool was_wave = config.wave;
+    config.wave = false;
+    xSemaphoreGive(dac_mutex);
+    if (was_wave) {
+        wave_close(net);
+    }
+
+    // 32-bit accumulator at 20 kHz: steps of 4.7 uHz
+    signal_phase[net] = 0;
+    signal_increment[net] = (uint32_t)llround(freq * 4294967296.0 / SIGNAL_SAMPLE_RATE_HZ);
+    update_signal_timer();
+    adc_dma_mark_stimulus();
+
+    ESP_LOGD(TAG, "Signal on source %d: shape %d at %.3f Hz, %ld mV around %ld mV",
+             net, wave->shape, freq, (long)config.amplitude_mv, (long)config.offset_mv);
+}
+
+bool hal_start_wave(source_net_t net, uint32_t name_hash, uint32_t rate_hz, bool loop) {
+    if (net >= SOURCE_COUNT) {
+        ESP_LOGE(TAG, "Invalid source net: %d", net);
+        return false;
+    }
+    if (rate_hz == 0 || rate_hz > SIGNAL_SAMPLE_RATE_HZ) {
+        ESP_LOGE(TAG, "Wave rate %lu Hz outside 1..%d Hz", (unsigned long)rate_hz, SIGNAL_SAMPLE_RATE_HZ);
+        hal_stop_signal(net);
+        return false;
+    }
+
+    // Wait for signal_task to finish the current sample before the wave changes
+    signal_increment[net] = 0;
+    xSemaphoreTake(dac_mutex, portMAX_DELAY);
+    signal_config[net].wave = false;
+    xSemaphoreGive(dac_mutex);
+    if (!wave_open(net, name_hash, loop)) {
+        hal_stop_signal(net);
+        return false;
+    }
+
+    // One sample per 65536 of phase; the first tick plays sample 0
+    uint32_t increment = (uint32_t)(((uint64_t)rate_hz << 16) / SIGNAL_SAMPLE_RATE_HZ);
+    signal_config_t& config = signal_config[net];
+    config.wave_last = increment;
+    config.wave_frac = 0;
+    config.wave = true;
+    signal_phase[net] = 0;
+    signal_increment[net] = increment;
+    update_signal_timer();
+    adc_dma_mark_stimulus();
+
+    ESP_LOGD(TAG, "Wave on source %d at %lu Hz", net, (unsigned long)rate_hz);
+    return true;
+}
+
+void hal_stop_signal(source_net_t net) {
+    // A DC write stops the generator and leaves the source at 0 V
+    hal_set_source(net, 0);
+}
+
+uint32_t hal_signal_phase(source_net_t net) {
+    return net < SOURCE_COUNT ? signal_phase[net] : 0;
+}
+
 void hal_init() {
     // Initialize serial port
     Serial.begin(921600);
@@ -113,20 +372,38 @@ void hal_init() {
     esp_log_level_set("*", ESP_LOG_INFO);
     esp_log_level_set("hal", ESP_LOG_INFO);  // Set log level for hal tag
 
+    for (int i = 0; i < SOURCE_COUNT; i++) {
+        source_lut_ideal((source_net_t)i);
+    }
+
     // Initialize signal generator arrays
     for (int i = 0; i < SOURCE_COUNT; i++) {
-        signal_frequencies[i] = 0;
-        signal_generator_active[i] = false;
+        signal_increment[i] = 0;
         signal_phase[i] = 0;
     }
 
     // Initialize sine wave lookup table
     init_sine_table();
 
+    // DAC writer for the generator, above the test loop and the rail monitor
+    dac_mutex = xSemaphoreCreateMutex();
+    BaseType_t result = xTaskCreatePinnedToCore(
+        signal_task,              // Task function
+        "signal_task",            // Task name
+        2048,                     // Stack size (bytes)
+        NULL,                     // Task parameters
+        SIGNAL_TASK_PRIORITY,     // Samples must not wait for the test loop
+        &signal_task_handle,      // Task handle
+        1                         // Core to run on (Core 1)
+    );
+    if (result != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create signal generator task");
+    }
+
     // Initialize signal generator timer
     signal_timer = timerBegin(2000000); // 2 MHz frequency
     timerAttachInterrupt(signal_timer, &signal_generator_callback);
-    timerAlarm(signal_timer, 100, true, 0); // 20 kHz frequency
+    timerAlarm(signal_timer, 2000000 / SIGNAL_SAMPLE_RATE_HZ, true, 0); // 20 kHz frequency
     timerStop(signal_timer);
 
     // Initialize ADC pins
@@ -181,6 +458,214 @@ void write_dac(int cs_pin, uint8_t channel, uint16_t value) {
     digitalWrite(cs_pin, HIGH);
 }
 
+// Register base addresses by shadow index. With IOCON.BANK = 0 the port B
+// register directly follows port A, so both ports go in one transaction.
+static const uint8_t mcp_register_base[] = {MCP23XXX_IODIR, MCP23XXX_GPPU, MCP23XXX_OLAT};
+
+void Micro_MCP23X17::syncCache() {
+    for (uint8_t reg = 0; reg < REG_COUNT; reg++) {
+        Adafruit_BusIO_Register both(i2c_dev, spi_dev, MCP23XXX_SPIREG, getRegister(mcp_register_base[reg], 0), 2);
+        shadow[reg] = written[reg] = both.read();
+    }
+}
+
+void Micro_MCP23X17::setPinMode(uint8_t pin, uint8_t mode) {
+    if (pin >= 16) {
+        return;
+    }
+    uint16_t bit = 1u << pin;
+    // Anything but OUTPUT is an input, like Adafruit_MCP23XXX::pinMode()
+    shadow[REG_IODIR] = (mode == OUTPUT) ? (shadow[REG_IODIR] & ~bit) : (shadow[REG_IODIR] | bit);
+    shadow[REG_GPPU] = (mode == INPUT_PULLUP) ? (shadow[REG_GPPU] | bit) : (shadow[REG_GPPU] & ~bit);
+}
+
+void Micro_MCP23X17::setPinLevel(uint8_t pin, uint8_t value) {
+    if (pin >= 16) {
+        return;
+    }
+    uint16_t bit = 1u << pin;
+    shadow[REG_OLAT] = value ? (shadow[REG_OLAT] | bit) : (shadow[REG_OLAT] & ~bit);
+}
+
+void Micro_MCP23X17::writeRegister(uint8_t reg) {
+    uint16_t changed = shadow[reg] ^ written[reg];
+    if (!changed) {
+        return;
+    }
+    if ((changed & 0x00FF) && (changed & 0xFF00)) {
+        Adafruit_BusIO_Register both(i2c_dev, spi_dev, MCP23XXX_SPIREG, getRegister(mcp_register_base[reg], 0), 2);
+        both.write(shadow[reg], 2);
+    } else {
+        uint8_t port = (changed & 0x00FF) ? 0 : 1;
+        Adafruit_BusIO_Register one(i2c_dev, spi_dev, MCP23XXX_SPIREG, getRegister(mcp_register_base[reg], port));
+        one.write(port ? shadow[reg] >> 8 : shadow[reg] & 0xFF);
+    }
+    written[reg] = shadow[reg];
+    adc_dma_mark_stimulus();
+}
+
+void Micro_MCP23X17::flush() {
+    writeRegister(REG_OLAT);
+    writeRegister(REG_GPPU);
+    writeRegister(REG_IODIR);
+}
+
+void Micro_MCP23X17::pinMode(uint8_t pin, uint8_t mode) {
+    setPinMode(pin, mode);
+    flush();
+}
+
+void Micro_MCP23X17::digitalWrite(uint8_t pin, uint8_t value) {
+    setPinLevel(pin, value);
+    flush();
+}
+
+void Micro_MCP23X17::writeMode(uint8_t value, uint8_t port) {
+    shadow[REG_IODIR] = port ? ((shadow[REG_IODIR] & 0x00FF) | (value << 8)) : ((shadow[REG_IODIR] & 0xFF00) | value);
+    writeRegister(REG_IODIR);
+}
+
+void Micro_MCP23X17::writePullup(uint8_t value, uint8_t port) {
+    shadow[REG_GPPU] = port ? ((shadow[REG_GPPU] & 0x00FF) | (value << 8)) : ((shadow[REG_GPPU] & 0xFF00) | value);
+    writeRegister(REG_GPPU);
+}
+
+void hal_set_io(mcp_io_t io_pin, io_state_t state) {
+    // Mode and level are flushed together, at most one OLAT and one IODIR write
+    if (state == IO_INPUT) {
+        mcp0.setPinMode(io_pin, INPUT);
+    } else {
+        mcp0.setPinLevel(io_pin, state == IO_HIGH ? HIGH : LOW);
+        mcp0.setPinMode(io_pin, OUTPUT);
+    }
+    mcp0.flush();
+}
+
+void hal_set_io_port(uint16_t mask, uint16_t levels, uint16_t inputs) {
+    for (uint8_t pin = 0; pin < 16; pin++) {
+        uint16_t bit = 1u << pin;
+        if (!(mask & bit)) {
+            continue;
+        }
+        if (inputs & bit) {
+            mcp0.setPinMode(pin, INPUT);
+        } else {
+            mcp0.setPinLevel(pin, (levels & bit) ? HIGH : LOW);
+            mcp0.setPinMode(pin, OUTPUT);
+        }
+    }
+    mcp0.flush();
+}
+
+uint16_t hal_read_io_port() {
+    return mcp0.readGPIOAB();
+}
+
+void hal_reset_io() {
+    // All IO pins to HiZ inputs without pullups, registers already there are not written
+    mcp0.writePullup(0x00, 0);
+    mcp0.writePullup(0x00, 1);
+    mcp0.writeMode(0xFF, 0);
+    mcp0.writeMode(0xFF, 1);
+}
+
+// PASS pin levels from one read of MCP1 port B, which also clears its interrupt
+static uint8_t read_rails_bits() {
+    uint8_t port = mcp1.readGPIOB();
+    uint8_t bits = 0;
+    if (port & (1 << (PIN_P12V_PASS - GPB))) bits |= RAILS_BIT_12V;
+    if (port & (1 << (PIN_P5V_PASS - GPB))) bits |= RAILS_BIT_5V;
+    if (!(port & (1 << (PIN_M12V_PASS - GPB)))) bits |= RAILS_BIT_M12V;  // Inverted signal
+    return bits;
+}
+
+static void publish_rails(uint8_t bits) {
+    rails_bits = bits;
+    EventBits_t level = (bits == RAILS_BITS_ALL) ? RAILS_EVENT_ALL : (bits == 0) ? RAILS_EVENT_NONE : 0;
+    xEventGroupClearBits(rails_events, (RAILS_EVENT_ALL | RAILS_EVENT_NONE) & ~level);
+    if (level) {
+        xEventGroupSetBits(rails_events, level);
+    }
+}
+
+static void IRAM_ATTR rails_isr() {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(rails_task_handle, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void rails_task(void* parameter) {
+    uint8_t last = rails_bits;
+    TickType_t period = pdMS_TO_TICKS(PIN_IO1_INT >= 0 ? RAILS_IDLE_MS : RAILS_POLL_MS);
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, period);
+        uint8_t bits = read_rails_bits();
+        if (bits == last) {
+            continue;
+        }
+
+        // Debounce: publish once two reads RAILS_DEBOUNCE_MS apart agree
+        uint8_t previous;
+        do {
+            previous = bits;
+            vTaskDelay(pdMS_TO_TICKS(RAILS_DEBOUNCE_MS));
+            bits = read_rails_bits();
+        } while (bits != previous);
+
+        if (bits != last) {
+            last = bits;
+            publish_rails(bits);
+            ESP_LOGD(TAG, "Power rails changed: 0x%x", bits);
+        }
+    }
+}
+
+void hal_rails_monitor_start() {
+    rails_events = xEventGroupCreate();
+
+    if (PIN_IO1_INT >= 0) {
+        // Any change of a PASS pin drives the mirrored INT outputs low until GPIO is read
+        mcp1.setupInterrupts(true, false, LOW);
+        mcp1.setupInterruptPin(PIN_P12V_PASS, CHANGE);
+        mcp1.setupInterruptPin(PIN_P5V_PASS, CHANGE);
+        mcp1.setupInterruptPin(PIN_M12V_PASS, CHANGE);
+        pinMode(PIN_IO1_INT, INPUT_PULLUP);
+    }
+
+    // Publish the current state before anyone asks for it
+    publish_rails(read_rails_bits());
+
+    BaseType_t result = xTaskCreatePinnedToCore(
+        rails_task,               // Task function
+        "rails_task",             // Task name
+        2048,                     // Stack size (bytes)
+        NULL,                     // Task parameters
+        2,                        // Above the test loop, so changes are seen at once
+        &rails_task_handle,       // Task handle
+        1                         // Core to run on (Core 1)
+    );
+    if (result != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create power rail monitor task");
+        return;
+    }
+
+    if (PIN_IO1_INT >= 0) {
+        attachInterrupt(PIN_IO1_INT, rails_isr, FALLING);
+    }
+}
+
+uint8_t hal_rails_state() {
+    return rails_bits;
+}
+
+void hal_rails_wait(bool connected) {
+    if (!rails_events) {
+        delay(RAILS_POLL_MS);
+        return;
+    }
+    xEventGroupWaitBits(rails_events, connected ? RAILS_EVENT_ALL : RAILS_EVENT_NONE, pdFALSE, pdFALSE, portMAX_DELAY);
+}
+
 void mcp_init() {
     // Initialize reset pins
     pinMode(PIN_IO0_RST, OUTPUT);
@@ -202,10 +687,13 @@ void mcp_init() {
         return;
     }
 
+    mcp0.syncCache();
+
     // Configure all MCP0 pins as outputs
     for(int i = 0; i < 16; i++) {
-        mcp0.pinMode(i, OUTPUT);
+        mcp0.setPinMode(i, OUTPUT);
     }
+    mcp0.flush();
 
     // Initialize MCP1
     if (!mcp1.begin_I2C(MCP_ADDR_1)) {
@@ -213,37 +701,58 @@ void mcp_init() {
         return;
     }
 
+    mcp1.syncCache();
+
     // Configure MCP1 pins
-    mcp1.pinMode(PIN_LED_OK, OUTPUT);
-    mcp1.pinMode(PIN_LED_FAIL, OUTPUT);
-    mcp1.pinMode(PIN_P12V_PASS, INPUT);
-    mcp1.pinMode(PIN_P5V_PASS, INPUT);
-    mcp1.pinMode(PIN_M12V_PASS, INPUT);
+    mcp1.setPinMode(PIN_LED_OK, OUTPUT);
+    mcp1.setPinMode(PIN_LED_FAIL, OUTPUT);
+    mcp1.setPinMode(PIN_P12V_PASS, INPUT);
+    mcp1.setPinMode(PIN_P5V_PASS, INPUT);
+    mcp1.setPinMode(PIN_M12V_PASS, INPUT);
 
     // Configure PD sink pins as outputs
-    mcp1.pinMode(PIN_SINK_PD_A, OUTPUT);
-    mcp1.pinMode(PIN_SINK_PD_B, OUTPUT);
-    mcp1.pinMode(PIN_SINK_PD_C, OUTPUT);
+    mcp1.setPinMode(PIN_SINK_PD_A, OUTPUT);
+    mcp1.setPinMode(PIN_SINK_PD_B, OUTPUT);
+    mcp1.setPinMode(PIN_SINK_PD_C, OUTPUT);
 
     // Configure ID pins (GPA0-GPA4) with pullup
     for(int i = 0; i < 5; i++) {
-        mcp1.pinMode(i, INPUT_PULLUP);
+        mcp1.setPinMode(i, INPUT_PULLUP);
     }
+    mcp1.flush();
+
+    hal_rails_monitor_start();
 }
 
-// Helper function to get median value from an array
+// Helper function to get median value from an array, the array is left untouched.
+// Full filter windows go through the selection network, partial ones through nth_element
 int get_median(int arr[], int size) {
-    // Create a copy of the array to avoid modifying the original
-    int temp[size];
-    for(int i = 0; i < size; i++) {
-        temp[i] = arr[i];
+    if (size == MEDIAN_FILTER_SIZE) {
+        return median_fixed<MEDIAN_FILTER_SIZE>(arr);
     }
+    return median_any(arr, size);
+}
+
+// PD and Z sinks have no reference of their own, they use the 1k sinks' average
+static void derive_adc_references() {
+    // Calculate average of 1k sink values
+    int32_t avg_1k = 0;
+    for(ADC_sink_t idx = ADC_sink_1k_A; idx <= ADC_sink_1k_F; idx = (ADC_sink_t)(idx + 1)) {
+        avg_1k += ref_adc_values[idx];
+    }
+    avg_1k /= 6; // Number of 1k sinks
+    
+    ESP_LOGD(TAG, "Average 1k sink value: %d", avg_1k);
     
-    // Sort the array
-    std::sort(temp, temp + size);
+    // Use average 1k value for PD and Z sinks
+    for(ADC_sink_t idx = ADC_sink_PD_A; idx <= ADC_sink_Z_F; idx = (ADC_sink_t)(idx + 1)) {
+        ref_adc_values[idx] = avg_1k;
+    }
     
-    // Return the middle element
-    return temp[size / 2];
+    ESP_LOGD(TAG, "ADC calibration complete. Reference values:");
+    for(ADC_sink_t idx = (ADC_sink_t)0; idx < ADC_sink_count; idx = (ADC_sink_t)(idx + 1)) {
+        ESP_LOGD(TAG, "ADC %d: raw=%d", idx, ref_adc_values[idx]);
+    }
 }
 
 void hal_adc_calibrate() {
@@ -272,24 +781,7 @@ void hal_adc_calibrate() {
         ref_adc_values[idx] = sum / CALIB_SAMPLES;
     }
     
-    // Calculate average of 1k sink values
-    int32_t avg_1k = 0;
-    for(ADC_sink_t idx = ADC_sink_1k_A; idx <= ADC_sink_1k_F; idx = (ADC_sink_t)(idx + 1)) {
-        avg_1k += ref_adc_values[idx];
-    }
-    avg_1k /= 6; // Number of 1k sinks
-    
-    ESP_LOGD(TAG, "Average 1k sink value: %d", avg_1k);
-    
-    // Use average 1k value for PD and Z sinks
-    for(ADC_sink_t idx = ADC_sink_PD_A; idx <= ADC_sink_Z_F; idx = (ADC_sink_t)(idx + 1)) {
-        ref_adc_values[idx] = avg_1k;
-    }
-    
-    ESP_LOGD(TAG, "ADC calibration complete. Reference values:");
-    for(ADC_sink_t idx = (ADC_sink_t)0; idx < ADC_sink_count; idx = (ADC_sink_t)(idx + 1)) {
-        ESP_LOGD(TAG, "ADC %d: raw=%d", idx, ref_adc_values[idx]);
-    }
+    derive_adc_references();
 }
 
 int32_t hal_adc_raw2mv(int32_t raw, ADC_sink_t idx) {
@@ -301,26 +793,40 @@ int32_t hal_adc_raw2mv(int32_t raw, ADC_sink_t idx) {
     return millivolts;
 }
 
+// Median of MEDIAN_FILTER_SIZE samples of one sink, raw; false if the sink cannot be sampled
+static bool adc_sink_median(ADC_sink_t idx, int* raw) {
+    adc_dma_value_t value;
+    if (adc_dma_read(idx, MEDIAN_FILTER_SIZE, &value)) {
+        *raw = value.median;
+        return true;
+    }
+
+    bool resume;
+    if (!adc_dma_oneshot_begin(idx, &resume)) {
+        return false;
+    }
+    int samples[MEDIAN_FILTER_SIZE];
+    for(int i = 0; i < MEDIAN_FILTER_SIZE; i++) {
+        samples[i] = analogRead(ADC_PINS[idx]);
+        delayMicroseconds(1); // Small delay between samples
+    }
+    adc_dma_oneshot_end(resume);
+    *raw = get_median(samples, MEDIAN_FILTER_SIZE);
+    return true;
+}
+
 int32_t hal_adc_read(ADC_sink_t idx) {
     if (idx >= ADC_sink_count) {
         ESP_LOGE(TAG, "Invalid ADC sink index");
         return 0;
     }
     
-    uint8_t pin = ADC_PINS[idx];
-    
-    // Apply median filter
-    int samples[MEDIAN_FILTER_SIZE];
-    
-    // Take multiple samples
-    for(int i = 0; i < MEDIAN_FILTER_SIZE; i++) {
-        samples[i] = analogRead(pin);
-        delayMicroseconds(1); // Small delay between samples
+    // ADC1 sinks come from the DMA rings, the others are sampled here
+    int raw;
+    if (!adc_sink_median(idx, &raw)) {
+        return HAL_ADC_INVALID;
     }
     
-    // Get median value
-    int raw = get_median(samples, MEDIAN_FILTER_SIZE);
-    
     // Convert to millivolts (3.3V reference, 12-bit ADC)
     int32_t millivolts = hal_adc_raw2mv(raw, idx);
     
@@ -330,6 +836,58 @@ int32_t hal_adc_read(ADC_sink_t idx) {
     return millivolts;
 }
 
+void hal_adc_read_multi(const ADC_sink_t* sinks, size_t count, int32_t* millivolts) {
+    if (count > ADC_sink_count) {
+        ESP_LOGE(TAG, "Too many ADC sinks in one sweep: %zu", count);
+        count = ADC_sink_count;
+    }
+
+    // Sinks the DMA engine converts are copied from their rings, the others
+    // are sampled round-robin, so every sink gets its median from samples
+    // spread over the whole sweep and the other channels space them out
+    int raws[ADC_sink_count] = {0};
+    bool sampled[ADC_sink_count] = {false};
+    bool any_sampled = false;
+    for (size_t j = 0; j < count; j++) {
+        adc_dma_value_t value;
+        if (sinks[j] < ADC_sink_count && adc_dma_read(sinks[j], MEDIAN_FILTER_SIZE, &value)) {
+            raws[j] = value.median;
+        } else {
+            sampled[j] = sinks[j] < ADC_sink_count;
+            any_sampled |= sampled[j];
+        }
+    }
+
+    // The engine, if still running, is stopped once for all on-demand reads
+    bool resume = false;
+    bool failed[ADC_sink_count] = {false};
+    for (size_t j = 0; j < count; j++) {
+        bool stopped = false;
+        if (sampled[j] && !adc_dma_oneshot_begin(sinks[j], &stopped)) {
+            sampled[j] = false;
+            failed[j] = true;
+        }
+        resume |= sampled[j] && stopped;
+    }
+
+    int samples[ADC_sink_count][MEDIAN_FILTER_SIZE];
+    for (int i = 0; any_sampled && i < MEDIAN_FILTER_SIZE; i++) {
+        for (size_t j = 0; j < count; j++) {
+            if (sampled[j]) {
+                samples[j][i] = analogRead(ADC_PINS[sinks[j]]);
+            }
+        }
+        delayMicroseconds(1);
+    }
+    adc_dma_oneshot_end(resume);
+
+    for (size_t j = 0; j < count; j++) {
+        int raw = sampled[j] ? get_median(samples[j], MEDIAN_FILTER_SIZE) : raws[j];
+        millivolts[j] = failed[j] ? HAL_ADC_INVALID : sinks[j] < ADC_sink_count ? hal_adc_raw2mv(raw, sinks[j]) : 0;
+        ESP_LOGD(TAG, "ADC sink %d: raw=%d, mV=%d", sinks[j], raw, millivolts[j]);
+    }
+}
+
 void hal_current_calibrate() {
     ESP_LOGD(TAG, "Starting current calibration...");
     
@@ -353,6 +911,26 @@ void hal_current_calibrate() {
              ref_current_12v, ref_current_5v, ref_current_m12v);
 }
 
+// Convert one INA196 ADC reading to microamps
+static int32_t current_from_raw(int raw) {
+    int32_t voltage = raw * 3300 / 4095;
+    return (voltage * 1000) / (SHUNT_RESISTOR * INA196_GAIN);
+}
+
+// Zero-current offset of a rail measured by hal_current_calibrate()
+static int32_t current_reference(uint8_t pin) {
+    switch(pin) {
+        case PIN_INA_12V:
+            return ref_current_12v;
+        case PIN_INA_5V:
+            return ref_current_5v;
+        case PIN_INA_M12V:
+            return ref_current_m12v;
+        default:
+            return 0;
+    }
+}
+
 // Helper function to measure raw current without calibration
 int32_t measure_current_raw(uint8_t pin) {
     // Apply median filter
@@ -370,32 +948,18 @@ int32_t measure_current_raw(uint8_t pin) {
 
     ESP_LOGD(TAG, "Current measurement - ADC: %d", raw);
     
-    int32_t voltage = raw * 3300 / 4095;
-    int32_t current = (voltage * 1000) / (SHUNT_RESISTOR * INA196_GAIN);
-    
-    return current;
+    return current_from_raw(raw);
 }
 
 int32_t measure_current(uint8_t pin) {
     int32_t current = measure_current_raw(pin);
     
     // Subtract reference value based on the pin
-    switch(pin) {
-        case PIN_INA_12V:
-            current -= ref_current_12v;
-            break;
-        case PIN_INA_5V:
-            current -= ref_current_5v;
-            break;
-        case PIN_INA_M12V:
-            current -= ref_current_m12v;
-            break;
-    }
+    current -= current_reference(pin);
 
     ESP_LOGD(TAG, "%s Current measurement - Raw: %d uA, Calibrated: %d uA", 
              pin == PIN_INA_12V ? "+12V" : pin == PIN_INA_5V ? "+5V" : "-12V",
-             current + (pin == PIN_INA_12V ? ref_current_12v : 
-                       pin == PIN_INA_5V ? ref_current_5v : ref_current_m12v),
+             current + current_reference(pin),
              current);
              
     current = max((int32_t)0, current);
@@ -403,6 +967,82 @@ int32_t measure_current(uint8_t pin) {
     return current;
 }
 
+// Sequential median test. The reading is the median of MEDIAN_FILTER_SIZE
+// samples; once more than half of them fall on one side of a limit, the
+// remaining samples cannot move the median back, so sampling stops there.
+// Readings near a limit still take every sample, and the verdict always
+// matches the one the full median would give. Values are compared after
+// conversion, which is monotonic, so their median is the converted median.
+static int32_t sample_median_in_range(uint8_t pin, uint32_t gap_us, int32_t (*convert)(int raw, int arg), int arg,
+                                      int32_t min, int32_t max, bool* in_range, int* taken) {
+    const int majority = MEDIAN_FILTER_SIZE / 2 + 1;
+    int values[MEDIAN_FILTER_SIZE];
+    int below = 0, above = 0;
+    int count = 0;
+
+    while (count < MEDIAN_FILTER_SIZE) {
+        int32_t value = convert(analogRead(pin), arg);
+        values[count++] = value;
+        below += value < min;
+        above += value > max;
+
+        // Decided: the median is outside the range, or at least a majority lies on the inner side of both limits
+        if (below >= majority || above >= majority ||
+            (count - below >= majority && count - above >= majority)) {
+            break;
+        }
+        delayMicroseconds(gap_us);
+    }
+
+    *in_range = below < majority && above < majority;
+    *taken = count;
+    return get_median(values, count);
+}
+
+static int32_t adc_sample_to_mv(int raw, int idx) {
+    return hal_adc_raw2mv(raw, (ADC_sink_t)idx);
+}
+
+// Calibrated and clamped like measure_current()
+static int32_t current_sample_to_ua(int raw, int pin) {
+    return max((int32_t)0, current_from_raw(raw) - current_reference(pin));
+}
+
+int32_t hal_adc_read_range(ADC_sink_t idx, int32_t min_mv, int32_t max_mv, bool* in_range) {
+    if (idx >= ADC_sink_count) {
+        ESP_LOGE(TAG, "Invalid ADC sink index");
+        *in_range = false;
+        return 0;
+    }
+
+    // The rings hold the full median already, no early exit to gain
+    adc_dma_value_t value;
+    if (adc_dma_read(idx, MEDIAN_FILTER_SIZE, &value)) {
+        int32_t millivolts = hal_adc_raw2mv(value.median, idx);
+        *in_range = millivolts >= min_mv && millivolts <= max_mv;
+        ESP_LOGD(TAG, "ADC sink %d: %d mV, DMA sample at %lu us", idx, millivolts, value.timestamp_us);
+        return millivolts;
+    }
+
+    bool resume;
+    if (!adc_dma_oneshot_begin(idx, &resume)) {
+        *in_range = false;
+        return HAL_ADC_INVALID;
+    }
+    int taken;
+    int32_t millivolts = sample_median_in_range(ADC_PINS[idx], 1, adc_sample_to_mv, idx, min_mv, max_mv, in_range, &taken);
+    adc_dma_oneshot_end(resume);
+    ESP_LOGD(TAG, "ADC sink %d: %d mV from %d samples", idx, millivolts, taken);
+    return millivolts;
+}
+
+int32_t measure_current_range(uint8_t pin, int32_t min_ua, int32_t max_ua, bool* in_range) {
+    int taken;
+    int32_t current = sample_median_in_range(pin, 100, current_sample_to_ua, pin, min_ua, max_ua, in_range, &taken);
+    ESP_LOGD(TAG, "Current pin %d: %d uA from %d samples", pin, current, taken);
+    return current;
+}
+
 uint8_t hal_adapter_id() {
     uint8_t id = 0;
     
@@ -430,153 +1070,241 @@ void hal_print_current(void) {
              current_12v_ma, current_5v_ma, current_m12v_ma);
 }
 
-void hal_start_signal(source_net_t pin, float freq) {
-    if (pin >= SOURCE_COUNT) {
-        ESP_LOGE(TAG, "Invalid source pin: %d", pin);
-        return;
+void hal_clear_console(void) {
+    // Send ANSI escape sequences to:
+    // 1. Clear the screen (\033[2J)
+    // 2. Move cursor to home position (\033[H)
+    Serial.print("\033[2J\033[H");
+    Serial.flush();  // Ensure all data is sent
+}
+
+/**
+ * @brief Calibration file: the references of the last full calibration and the fixture they belong to
+ */
+typedef struct {
+    uint32_t magic;          // CALIB_MAGIC
+    uint16_t version;        // CALIB_VERSION
+    uint16_t boots;          // Boots that reused it since the full calibration
+    uint64_t fixture_id;     // eFuse MAC of the tester that measured it
+    uint32_t calibrated_at;  // time() of the full calibration, 0 when the clock was not set
+    int32_t current[3];      // ref_current_12v, ref_current_5v, ref_current_m12v
+    int32_t adc[ADC_sink_1k_F - ADC_sink_1k_A + 1];  // ref_adc_values of the 1k sinks
+} calibration_file_t;
+
+// Write the references with the given reuse count, replacing the file atomically
+static void write_calibration(uint16_t boots, uint32_t calibrated_at) {
+    calibration_file_t data;
+    data.magic = CALIB_MAGIC;
+    data.version = CALIB_VERSION;
+    data.boots = boots;
+    data.fixture_id = ESP.getEfuseMac();
+    data.calibrated_at = calibrated_at;
+    data.current[0] = ref_current_12v;
+    data.current[1] = ref_current_5v;
+    data.current[2] = ref_current_m12v;
+    for (int i = 0; i <= ADC_sink_1k_F - ADC_sink_1k_A; i++) {
+        data.adc[i] = ref_adc_values[ADC_sink_1k_A + i];
     }
-    
-    if (freq < 0.0f) {
-        ESP_LOGE(TAG, "Invalid frequency: %f Hz. Must be >= 0", freq);
+
+    File file = LittleFS.open(CALIB_PATH ".tmp", "w");
+    if (!file) {
+        ESP_LOGW(TAG, "Failed to open %s.tmp for writing", CALIB_PATH);
         return;
     }
-    
-    // Convert frequency to phase increment for 20kHz timer
-    // freq = phase_increment * 20000 / 256 
-    // phase_increment = freq * 256 * 128 decimation / 20000
-    uint32_t phase_increment = (uint32_t)(freq * 256.0f * 128 / 20000.0f);
-    
-    signal_frequencies[pin] = phase_increment;
-    signal_phase[pin] = 0; // Reset phase
+    bool written = file.write((const uint8_t*)&data, sizeof(data)) == sizeof(data);
+    file.close();
 
-    if (!signal_timer_running) {
-        timerStart(signal_timer);
-        signal_timer_running = true;
+    if (!written || !LittleFS.rename(CALIB_PATH ".tmp", CALIB_PATH)) {
+        ESP_LOGW(TAG, "Failed to write %s", CALIB_PATH);
+        LittleFS.remove(CALIB_PATH ".tmp");
     }
-    
-    ESP_LOGD(TAG, "Signal generator on source %d started with frequency %f Hz (phase increment: %d)", pin, freq, phase_increment);
 }
 
-void hal_stop_signal(source_net_t pin) {
-    if (pin >= SOURCE_COUNT) {
-        ESP_LOGE(TAG, "Invalid source pin: %d", pin);
-        return;
-    }
-
-    signal_frequencies[pin] = 0;
+void hal_calibration_save() {
+    time_t now = time(NULL);
+    // Anything before 2020 means the clock was never set
+    write_calibration(0, now > 1577836800 ? (uint32_t)now : 0);
+    ESP_LOGI(TAG, "Calibration stored in %s", CALIB_PATH);
+}
 
-    // Wait for signal generator to stop
-    int timeout = 100; // 100 ms timeout
-    while (signal_generator_active[pin] && timeout > 0) {
-        delay(1);
-        timeout--;
+bool hal_calibration_load() {
+    if (!LittleFS.exists(CALIB_PATH)) {
+        return false;
     }
-    
-    if (timeout <= 0) {
-        ESP_LOGW(TAG, "Timeout waiting for signal generator to stop on source %d", pin);
+    File file = LittleFS.open(CALIB_PATH, "r");
+    if (!file) {
+        return false;
     }
+    calibration_file_t data;
+    bool read = file.read((uint8_t*)&data, sizeof(data)) == sizeof(data);
+    file.close();
 
-    // ensure signal_generator_active is false
-    signal_generator_active[pin] = false;
+    if (!read || data.magic != CALIB_MAGIC || data.version != CALIB_VERSION) {
+        ESP_LOGI(TAG, "Stored calibration unreadable");
+        return false;
+    }
+    if (data.fixture_id != ESP.getEfuseMac()) {
+        ESP_LOGI(TAG, "Stored calibration belongs to another fixture");
+        return false;
+    }
+    if (data.boots >= CALIB_MAX_BOOTS) {
+        ESP_LOGI(TAG, "Stored calibration is stale after %u boots", data.boots);
+        return false;
+    }
 
-    // if all signal generators are stopped and timer is not running, stop the timer
-    if (signal_generator_active[0] == false &&
-        signal_generator_active[1] == false &&
-        signal_generator_active[2] == false &&
-        signal_generator_active[3] == false) {
-        if (signal_timer_running) {
-            timerStop(signal_timer);
-            signal_timer_running = false;
+    // One median per input tells whether the offsets moved, in a few
+    // milliseconds instead of the averaged calibration runs
+    const uint8_t current_pins[3] = {PIN_INA_12V, PIN_INA_5V, PIN_INA_M12V};
+    for (int i = 0; i < 3; i++) {
+        int32_t current = measure_current_raw(current_pins[i]);
+        if (abs(current - data.current[i]) > CALIB_CURRENT_TOLERANCE_UA) {
+            ESP_LOGI(TAG, "Stored calibration out of tolerance: rail %d at %d uA, stored %d uA",
+                     i, current, data.current[i]);
+            return false;
+        }
+    }
+    for (int i = 0; i <= ADC_sink_1k_F - ADC_sink_1k_A; i++) {
+        int raw;
+        if (!adc_sink_median((ADC_sink_t)(ADC_sink_1k_A + i), &raw)) {
+            return false;
+        }
+        if (abs(raw - data.adc[i]) > CALIB_ADC_TOLERANCE) {
+            ESP_LOGI(TAG, "Stored calibration out of tolerance: ADC %d at %d, stored %d", i, raw, data.adc[i]);
+            return false;
         }
     }
 
-    ESP_LOGD(TAG, "Stopped signal generator on source %d", pin);
-}
+    ref_current_12v = data.current[0];
+    ref_current_5v = data.current[1];
+    ref_current_m12v = data.current[2];
+    for (int i = 0; i <= ADC_sink_1k_F - ADC_sink_1k_A; i++) {
+        ref_adc_values[ADC_sink_1k_A + i] = data.adc[i];
+    }
+    derive_adc_references();
 
-void hal_set_source(source_net_t net, int32_t voltage_mv) {
-    ESP_LOGD(TAG, "Phase: %d", signal_phase[net]);
+    write_calibration(data.boots + 1, data.calibrated_at);
+    ESP_LOGI(TAG, "Using stored calibration, reused %u times", data.boots + 1);
+    return true;
+}
 
+/**
+ * @brief Source calibration file: the LUT of every source and the fixture it was measured on
+ */
+typedef struct {
+    uint32_t magic;          // SOURCE_CAL_MAGIC
+    uint16_t version;        // SOURCE_CAL_VERSION
+    uint16_t calibrated;     // Bit per calibrated source, the others hold ideal codes
+    uint64_t fixture_id;     // eFuse MAC of the tester that measured it
+    uint16_t lut[SOURCE_COUNT][SOURCE_LUT_POINTS];
+} source_calibration_file_t;
+
+static void save_source_calibration() {
+    source_calibration_file_t data;
+    data.magic = SOURCE_CAL_MAGIC;
+    data.version = SOURCE_CAL_VERSION;
+    data.calibrated = source_calibrated;
+    data.fixture_id = ESP.getEfuseMac();
+    memcpy(data.lut, source_lut, sizeof(data.lut));
+
+    File file = LittleFS.open(SOURCE_CAL_PATH ".tmp", "w");
+    if (!file) {
+        ESP_LOGW(TAG, "Failed to open %s.tmp for writing", SOURCE_CAL_PATH);
+        return;
+    }
+    bool written = file.write((const uint8_t*)&data, sizeof(data)) == sizeof(data);
+    file.close();
 
-    if (signal_timer_running) {
-        timerStop(signal_timer);
+    if (!written || !LittleFS.rename(SOURCE_CAL_PATH ".tmp", SOURCE_CAL_PATH)) {
+        ESP_LOGW(TAG, "Failed to write %s", SOURCE_CAL_PATH);
+        LittleFS.remove(SOURCE_CAL_PATH ".tmp");
     }
+}
 
-    // Stop signal generator for this source
-    hal_stop_signal(net);
-    
-    // for some reason, fall without this logi
-    ESP_LOGD(TAG, "Signal stopped");
-    
-    // Validate voltage range (in millivolts)
-    if (voltage_mv < -5000 || voltage_mv > 5000) {
-        ESP_LOGE(TAG, "Invalid voltage: %d mV. Must be between -5000 and +5000 mV", voltage_mv);
+void hal_source_calibration_load() {
+    if (!LittleFS.exists(SOURCE_CAL_PATH)) {
         return;
     }
-
-    // Validate net
-    if (net >= SOURCE_COUNT) {
-        ESP_LOGE(TAG, "Invalid source net: %d", net);
+    File file = LittleFS.open(SOURCE_CAL_PATH, "r");
+    if (!file) {
         return;
     }
+    source_calibration_file_t data;
+    bool read = file.read((uint8_t*)&data, sizeof(data)) == sizeof(data);
+    file.close();
 
-    // Convert millivolts to voltage
-    float voltage = voltage_mv / 1000.0f;
-
-    // Convert voltage to DAC value (0-65535)
-    // -5V = 0, 0V = 32768, +5V = 65535
-    uint16_t dac_value = (uint16_t)((voltage + 5.0f) * 65535.0f / 10.0f);
+    if (!read || data.magic != SOURCE_CAL_MAGIC || data.version != SOURCE_CAL_VERSION ||
+        data.fixture_id != ESP.getEfuseMac()) {
+        ESP_LOGW(TAG, "Stored source calibration does not match this fixture, using ideal codes");
+        return;
+    }
+    memcpy(source_lut, data.lut, sizeof(source_lut));
+    source_calibrated = data.calibrated;
+    ESP_LOGI(TAG, "Source calibration loaded, calibrated sources: 0x%x", source_calibrated);
+}
 
-    // Set the voltage using direct function with DAC value
-    hal_set_source_direct(net, dac_value);
-    
-    ESP_LOGD(TAG, "Source %d set to %d mV (%.2f V, DAC value: %d)", net, voltage_mv, voltage, dac_value);
+bool hal_source_calibrate(source_net_t net, ADC_sink_t sink, int32_t* max_error_mv) {
+    *max_error_mv = 0;
+    if (net >= SOURCE_COUNT || sink >= ADC_sink_count) {
+        ESP_LOGE(TAG, "Invalid source calibration %d -> %d", net, sink);
+        return false;
+    }
 
-    if(signal_timer_running) {
-        timerStart(signal_timer);
+    // Step through ideal codes and average the sink readings at each one
+    int32_t codes[SOURCE_CAL_POINTS];
+    int32_t measured[SOURCE_CAL_POINTS];
+    const int32_t span_mv = 8000;
+    for (int p = 0; p < SOURCE_CAL_POINTS; p++) {
+        codes[p] = source_ideal_code(-span_mv / 2 + p * span_mv / (SOURCE_CAL_POINTS - 1));
+        hal_set_source_direct(net, (uint16_t)codes[p]);
+        delay(SOURCE_CAL_SETTLE_MS);
+        int32_t sum = 0;
+        for (int r = 0; r < SOURCE_CAL_READS; r++) {
+            // Far enough apart that every median comes from new samples
+            delay(1);
+            sum += hal_adc_read(sink);
+        }
+        measured[p] = sum / SOURCE_CAL_READS;
     }
-}
 
-void hal_clear_console(void) {
-    // Send ANSI escape sequences to:
-    // 1. Clear the screen (\033[2J)
-    // 2. Move cursor to home position (\033[H)
-    Serial.print("\033[2J\033[H");
-    Serial.flush();  // Ensure all data is sent
-}
+    // Least-squares line measured = gain * code + offset
+    double mean_code = 0, mean_mv = 0;
+    for (int p = 0; p < SOURCE_CAL_POINTS; p++) {
+        mean_code += codes[p];
+        mean_mv += measured[p];
+    }
+    mean_code /= SOURCE_CAL_POINTS;
+    mean_mv /= SOURCE_CAL_POINTS;
+    double sxy = 0, sxx = 0;
+    for (int p = 0; p < SOURCE_CAL_POINTS; p++) {
+        sxy += (codes[p] - mean_code) * (measured[p] - mean_mv);
+        sxx += (codes[p] - mean_code) * (codes[p] - mean_code);
+    }
+    double gain = sxy / sxx;
+    double offset = mean_mv - gain * mean_code;
 
-void hal_set_io(mcp_io_t io_pin, io_state_t state) {
-    if (state == IO_INPUT) {
-        mcp0.pinMode(io_pin, INPUT);
-    } else if (state == IO_HIGH) {
-        mcp0.pinMode(io_pin, OUTPUT);
-        mcp0.digitalWrite(io_pin, HIGH);
-    } else if (state == IO_LOW) {
-        mcp0.pinMode(io_pin, OUTPUT);
-        mcp0.digitalWrite(io_pin, LOW);
+    double max_error = 0;
+    for (int p = 0; p < SOURCE_CAL_POINTS; p++) {
+        max_error = max(max_error, fabs(measured[p] - (gain * codes[p] + offset)));
+    }
+    *max_error_mv = (int32_t)lround(max_error);
+
+    const double ideal_gain = (double)(SOURCE_MV_MAX - SOURCE_MV_MIN) / 65535;
+    hal_set_source_direct(net, (uint16_t)source_ideal_code(0));
+    if (fabs(gain / ideal_gain - 1) > SOURCE_CAL_GAIN_TOLERANCE) {
+        ESP_LOGE(TAG, "Source %d via sink %d: gain %.5f mV/code, expected %.5f, check the loopback",
+                 net, sink, gain, ideal_gain);
+        return false;
     }
-}
 
-void hal_reset_io() {
-    ESP_LOGD(TAG, "IO reset started");
-    
-    // Set all IO pins to HiZ (input mode) using bulk operation
-    // Port A (pins 0-7): all inputs
-    mcp0.writeMode(0xFF, 0);
-    // Port B (pins 8-15): all inputs  
-    mcp0.writeMode(0xFF, 1);
-    
-    ESP_LOGD(TAG, "IO reset finished");
-}
+    for (int k = 0; k < SOURCE_LUT_POINTS; k++) {
+        double code = (SOURCE_MV_MIN + k * SOURCE_LUT_STEP_MV - offset) / gain;
+        source_lut[net][k] = (uint16_t)constrain(lround(code), 0L, 65535L);
+    }
+    source_calibrated |= 1 << net;
+    save_source_calibration();
+    hal_set_source(net, 0);
 
-// Micro_MCP23X17 implementation
-void Micro_MCP23X17::writeMode(uint8_t value, uint8_t port) {
-    Adafruit_BusIO_Register IODIR(i2c_dev, spi_dev, MCP23XXX_SPIREG,
-                                  getRegister(MCP23XXX_IODIR, port));
-    IODIR.write(value);
+    ESP_LOGI(TAG, "Source %d calibrated via sink %d: gain %.5f mV/code, offset %.1f mV, max error %d mV",
+             net, sink, gain, offset, *max_error_mv);
+    return true;
 }
-
-void Micro_MCP23X17::writePullup(uint8_t value, uint8_t port) {
-    Adafruit_BusIO_Register GPPU(i2c_dev, spi_dev, MCP23XXX_SPIREG,
-                                 getRegister(MCP23XXX_GPPU, port));
-    GPPU.write(value);
-} 
\ No newline at end of file
@@ -48,14 +48,12 @@ void setup() {
         for(;;); // Don't proceed, loop forever
     }
 
+    // The module is looked up again on every insertion, an unknown adapter is not fatal
     module = get_current_module_info();
 
     if (!module) {
-        ESP_LOGE(TAG, "Unknown module detected");
-        for(;;);
+        ESP_LOGW(TAG, "Unknown module detected");
     }
-
-    allocate_test_results_arrays(module);
  
     // Initialize web server
     if (!init_webserver()) {
@@ -83,6 +81,23 @@ void loop() {
     
     wait_for_module_insertion(p12v_ok, p5v_ok, m12v_ok);
     
+    // Scripts saved from the editor take effect here, nothing references the old arena between runs
+    if (!reload_modules_if_requested()) {
+        ESP_LOGE(TAG, "Failed to reload modules, keeping the previous scripts");
+    }
+    // Only rates a saved script added are timed, before its first capture
+    measure_scope_rates();
+    
+    // The adapter may have been swapped, all programs are preloaded so switching is a lookup
+    set_current_module_index(hal_adapter_id());
+    module = get_current_module_info();
+    if (!module || !allocate_test_results_arrays(module)) {
+        ESP_LOGE(TAG, "No module script for adapter ID %zu", get_current_module_index());
+        display_printf("Unknown adapter\nID: %zu", get_current_module_index());
+        wait_for_module_removal(p12v_ok, p5v_ok, m12v_ok);
+        return;
+    }
+    
     // Reset all test results after module insertion
     reset_all_test_results();
 
@@ -93,8 +108,10 @@ void loop() {
     display_printf("Module: %s", module->name);
 
     bool test_result;
+    bool retest = false;
     do {
-        test_result = execute_module_tests(module);
+        test_result = execute_module_tests(module, retest);
+        retest = true;
         if (test_result) {
             display_printf("Module OK");
         } else {            
@@ -6,429 +6,481 @@
 #include <cstring>
 #include <cstdlib>
 #include "test_results.h"
+#include "script_parser.h"
+#include "script_registry.h"
+#include "delay_window.h"
+#include "wave_player.h"
 
 static const char* TAG = "modules";
 
-// Global variables for module storage
+// Size of the fixed buffer module scripts are streamed through
+#define SCRIPT_READ_CHUNK 512
+
+// Compiled programs are cached in /cache/<script name>.bin
+#define SCRIPT_CACHE_DIR "/cache"
+#define SCRIPT_CACHE_MAGIC 0x4252544Du   // "MTRB"
+#define SCRIPT_CACHE_VERSION 13          // Bump whenever test_operation_t, test_alias_t, test_group_t or test_limits_t changes
+
+/**
+ * @brief Header of a compiled program image, followed by the operations, alias and group arrays
+ */
+typedef struct {
+    uint32_t magic;          // SCRIPT_CACHE_MAGIC
+    uint16_t version;        // SCRIPT_CACHE_VERSION
+    uint16_t op_size;        // sizeof(test_operation_t) of the build that wrote it
+    uint32_t source_hash;    // FNV-1a of the script text
+    uint32_t source_size;    // Script size in bytes
+    uint32_t count;          // Number of operations
+    uint32_t alias_count;    // Number of aliases
+    uint32_t group_count;    // Number of test groups
+    uint32_t retest_groups;  // Retry a failed run from the failed group
+    test_limits_t limits;    // Script deadlines and retry backoff
+} script_cache_header_t;
+
+static char read_buffer[SCRIPT_READ_CHUNK];
+
+// Every module lives in one arena: module table, then all operations,
+// aliases, groups and names. module_by_id maps an adapter ID to its module.
+static void* module_arena = nullptr;
 static module_info_t* modules = nullptr;
 static size_t modules_count = 0;
+static int8_t module_by_id[MODULE_ID_COUNT];
 static size_t current_module_index = 0;
-static test_operation_t* operations_buffer = nullptr;
-static size_t operations_buffer_size = 0;
+static volatile bool modules_reload_requested = false;  // Set by the web server after a script is saved
+static const module_info_t* running_module = nullptr;
+static int failed_group = -1;   // Group of the last failed run, -1 to retry from the start
+
+/**
+ * @brief Program and name of a script while the arena is being built
+ */
+typedef struct {
+    uint8_t id;
+    char name[48];
+    script_program_t program;
+} module_load_t;
 
-static bool execute_test_sequence(const test_operation_t* operations, size_t count, test_operation_result_t* results, int loop_start, int loop_end);
+/**
+ * @brief State of one open loop while a program runs
+ */
+typedef struct {
+    int32_t remaining;    // Iterations left for counted loops
+    uint32_t start_ms;    // millis() when the loop was entered, for timed loops
+} loop_frame_t;
+
+/**
+ * @brief Readings of the last vmulti sweep
+ */
+typedef struct {
+    size_t first;         // Operation measured into millivolts[0]
+    size_t end;           // One past the last operation the sweep covers
+    size_t next;          // Operation the sweep may serve next, later reads need a new sweep
+    int32_t millivolts[ADC_sink_count];
+} pin_sweep_t;
+
+static bool execute_test_sequence(const test_operation_t* operations, size_t begin, size_t end, test_operation_result_t* results,
+                                  const test_limits_t& limits, uint32_t script_start, size_t* failed_pc);
 static bool execute_single_operation(const test_operation_t& op, int32_t* result);
 
-// Helper function to convert string to source_net_t
-static source_net_t string_to_source(const char* str) {
-    if (strcmp(str, "A") == 0) return SOURCE_A;
-    if (strcmp(str, "B") == 0) return SOURCE_B;
-    if (strcmp(str, "C") == 0) return SOURCE_C;
-    if (strcmp(str, "D") == 0) return SOURCE_D;
-    return SOURCE_A; // Default
+void set_current_module_index(size_t index) {
+    current_module_index = index;
 }
 
-// Helper function to convert string to io_state_t
-static io_state_t string_to_io_state(const char* str) {
-    if (strcmp(str, "h") == 0) return IO_HIGH;
-    if (strcmp(str, "l") == 0) return IO_LOW;
-    if (strcmp(str, "z") == 0) return IO_INPUT;
-    return IO_INPUT; // Default
+size_t get_current_module_index() {
+    return current_module_index;
 }
 
-// Helper function to convert string to current rail
-static int string_to_current_rail(const char* str) {
-    if (strcmp(str, "+12") == 0) return 0; // Maps to PIN_INA_12V
-    if (strcmp(str, "+5") == 0) return 1;  // Maps to PIN_INA_5V
-    if (strcmp(str, "-12") == 0) return 2; // Maps to PIN_INA_M12V
-    return 0; // Default
+// Hash the script source so the compiled image can be validated against it
+static void hash_script_file(File& file, uint32_t* hash, uint32_t* size) {
+    *hash = SCRIPT_HASH_INIT;
+    *size = 0;
+    size_t read_len;
+    while ((read_len = file.read((uint8_t*)read_buffer, sizeof(read_buffer))) > 0) {
+        *hash = script_hash_update(*hash, read_buffer, read_len);
+        *size += read_len;
+    }
 }
 
-// Helper function to convert string to voltage pin
-static ADC_sink_t string_to_voltage_pin(const char* str) {
-    if (strcmp(str, "A") == 0) return ADC_sink_1k_A;
-    if (strcmp(str, "B") == 0) return ADC_sink_1k_B;
-    if (strcmp(str, "C") == 0) return ADC_sink_1k_C;
-    if (strcmp(str, "D") == 0) return ADC_sink_1k_D;
-    if (strcmp(str, "E") == 0) return ADC_sink_1k_E;
-    if (strcmp(str, "F") == 0) return ADC_sink_1k_F;
-    if (strcmp(str, "pdA") == 0) return ADC_sink_PD_A;
-    if (strcmp(str, "pdB") == 0) return ADC_sink_PD_B;
-    if (strcmp(str, "pdC") == 0) return ADC_sink_PD_C;
-    if (strcmp(str, "zD") == 0) return ADC_sink_Z_D;
-    if (strcmp(str, "zE") == 0) return ADC_sink_Z_E;
-    if (strcmp(str, "zF") == 0) return ADC_sink_Z_F;
-    return ADC_sink_1k_A; // Default
-}
+// Parse the script in a single pass through the fixed read buffer
+static bool parse_script_file(File& file, script_program_t* program) {
+    static script_parser_t parser;
+    uint32_t start_time = micros();
 
-// Helper function to skip whitespace
-static const char* skip_whitespace(const char* str) {
-    while (*str == ' ' || *str == '\t') str++;
-    return str;
-}
+    script_parser_init(&parser);
+    bool parsed = true;
+    size_t read_len;
+    while (parsed && (read_len = file.read((uint8_t*)read_buffer, sizeof(read_buffer))) > 0) {
+        parsed = script_parser_feed(&parser, read_buffer, read_len);
+    }
+    parsed = parsed && script_parser_finish(&parser);
+
+    if (!parsed) {
+        script_parser_release(&parser);
+        return false;
+    }
 
-// Helper function to get next token
-static const char* get_token(const char* str, char* token, size_t max_len) {
-    str = skip_whitespace(str);
-    size_t i = 0;
-    while (*str && *str != ' ' && *str != '\t' && *str != '\n' && *str != '\r' && i < max_len - 1) {
-        token[i++] = *str++;
+    ESP_LOGD(TAG, "Parsed %zu lines into %zu operations in %lu us (%zu allocations)",
+             parser.line_number, parser.count, micros() - start_time, parser.allocations);
+    if (parser.errors > 0) {
+        ESP_LOGW(TAG, "Script has %zu errors and %zu warnings, see above", parser.errors, parser.warnings);
     }
-    token[i] = '\0';
-    return str;
+
+    script_parser_take_program(&parser, program);
+    return true;
 }
 
-void set_current_module_index(size_t index) {
-    current_module_index = index;
+// Load a compiled program image if it was built from the same source
+static bool load_cached_program(const char* cache_path, uint32_t source_hash, uint32_t source_size, script_program_t* program) {
+    if (!LittleFS.exists(cache_path)) {
+        return false;
+    }
+
+    File file = LittleFS.open(cache_path, "r");
+    if (!file) {
+        return false;
+    }
+
+    script_cache_header_t header;
+    if (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != SCRIPT_CACHE_MAGIC ||
+        header.version != SCRIPT_CACHE_VERSION ||
+        header.op_size != sizeof(test_operation_t) ||
+        header.source_hash != source_hash ||
+        header.source_size != source_size) {
+        ESP_LOGD(TAG, "Cached program %s is stale", cache_path);
+        file.close();
+        return false;
+    }
+
+    test_operation_t* ops = nullptr;
+    size_t ops_size = header.count * sizeof(test_operation_t);
+    if (header.count > 0) {
+        ops = (test_operation_t*)malloc(ops_size);
+        if (!ops || file.read((uint8_t*)ops, ops_size) != ops_size) {
+            ESP_LOGW(TAG, "Failed to read cached program %s", cache_path);
+            free(ops);
+            file.close();
+            return false;
+        }
+    }
+
+    test_alias_t* aliases = nullptr;
+    size_t aliases_size = header.alias_count * sizeof(test_alias_t);
+    if (header.alias_count > 0) {
+        aliases = (test_alias_t*)malloc(aliases_size);
+        if (!aliases || file.read((uint8_t*)aliases, aliases_size) != aliases_size) {
+            ESP_LOGW(TAG, "Failed to read cached aliases %s", cache_path);
+            free(aliases);
+            free(ops);
+            file.close();
+            return false;
+        }
+    }
+
+    test_group_t* groups = nullptr;
+    size_t groups_size = header.group_count * sizeof(test_group_t);
+    if (header.group_count > 0) {
+        groups = (test_group_t*)malloc(groups_size);
+        if (!groups || file.read((uint8_t*)groups, groups_size) != groups_size) {
+            ESP_LOGW(TAG, "Failed to read cached groups %s", cache_path);
+            free(groups);
+            free(aliases);
+            free(ops);
+            file.close();
+            return false;
+        }
+    }
+    file.close();
+
+    program->ops = ops;
+    program->count = header.count;
+    program->aliases = aliases;
+    program->alias_count = header.alias_count;
+    program->groups = groups;
+    program->group_count = header.group_count;
+    program->retest_groups = header.retest_groups != 0;
+    program->limits = header.limits;
+    return true;
 }
 
-size_t get_current_module_index() {
-    return current_module_index;
+// Write the compiled program image, replacing the previous one atomically
+static void save_cached_program(const char* cache_path, uint32_t source_hash, uint32_t source_size, const script_program_t* program) {
+    if (!LittleFS.exists(SCRIPT_CACHE_DIR) && !LittleFS.mkdir(SCRIPT_CACHE_DIR)) {
+        ESP_LOGW(TAG, "Failed to create %s", SCRIPT_CACHE_DIR);
+        return;
+    }
+
+    char tmp_path[96];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path);
+    File file = LittleFS.open(tmp_path, "w");
+    if (!file) {
+        ESP_LOGW(TAG, "Failed to open %s for writing", tmp_path);
+        return;
+    }
+
+    script_cache_header_t header;
+    header.magic = SCRIPT_CACHE_MAGIC;
+    header.version = SCRIPT_CACHE_VERSION;
+    header.op_size = sizeof(test_operation_t);
+    header.source_hash = source_hash;
+    header.source_size = source_size;
+    header.count = program->count;
+    header.alias_count = program->alias_count;
+    header.group_count = program->group_count;
+    header.retest_groups = program->retest_groups;
+    header.limits = program->limits;
+
+    size_t ops_size = program->count * sizeof(test_operation_t);
+    size_t aliases_size = program->alias_count * sizeof(test_alias_t);
+    size_t groups_size = program->group_count * sizeof(test_group_t);
+    bool written = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+    if (ops_size > 0) {
+        written = written && file.write((const uint8_t*)program->ops, ops_size) == ops_size;
+    }
+    if (aliases_size > 0) {
+        written = written && file.write((const uint8_t*)program->aliases, aliases_size) == aliases_size;
+    }
+    if (groups_size > 0) {
+        written = written && file.write((const uint8_t*)program->groups, groups_size) == groups_size;
+    }
+    file.close();
+
+    if (!written || !LittleFS.rename(tmp_path, cache_path)) {
+        ESP_LOGW(TAG, "Failed to write cached program %s", cache_path);
+        LittleFS.remove(tmp_path);
+        return;
+    }
+
+    ESP_LOGD(TAG, "Cached program written to %s", cache_path);
 }
 
-bool init_modules_from_fs() {
-    ESP_LOGD(TAG, "Initializing module from filesystem");
-    
-    if (!LittleFS.begin(true)) {
-        ESP_LOGE(TAG, "Failed to mount LittleFS");
+// Parse the module script or load its compiled image
+static bool load_module_program(const char* module_filename, script_program_t* program) {
+    char filepath[80];
+    snprintf(filepath, sizeof(filepath), "/modules/%s", module_filename);
+    File file = LittleFS.open(filepath, "r");
+    if (!file) {
+        ESP_LOGE(TAG, "Failed to open module file: %s", filepath);
         return false;
     }
     
-    // Format the index with leading zero (e.g., "01_" for index 1)
-    char prefix[10];
-    snprintf(prefix, sizeof(prefix), "%02zu_", current_module_index);
+    // Use the compiled image if the script has not changed since it was written
+    uint32_t source_hash, source_size;
+    hash_script_file(file, &source_hash, &source_size);
     
-    // Find the file in /modules directory that starts with the index
-    File dir = LittleFS.open("/modules");
-    if (!dir || !dir.isDirectory()) {
-        ESP_LOGE(TAG, "Failed to open /modules directory");
-        return false;
-    }
+    char cache_path[80];
+    snprintf(cache_path, sizeof(cache_path), SCRIPT_CACHE_DIR "/%s.bin", module_filename);
     
-    String module_filename = "";
-    File file = dir.openNextFile();
-    while (file) {
-        String name = file.name();
-        if (name.startsWith(prefix)) {
-            module_filename = name;
-            file.close();
-            break;
-        }
+    if (load_cached_program(cache_path, source_hash, source_size, program)) {
+        ESP_LOGD(TAG, "Loaded compiled program from %s", cache_path);
         file.close();
-        file = dir.openNextFile();
+        return true;
     }
-    dir.close();
     
-    if (module_filename.length() == 0) {
-        ESP_LOGE(TAG, "No module file found with prefix %s", prefix);
+    file.seek(0);
+    bool parsed = parse_script_file(file, program);
+    file.close();
+    if (!parsed) {
+        ESP_LOGE(TAG, "Failed to allocate memory for module %s", module_filename);
         return false;
     }
+    save_cached_program(cache_path, source_hash, source_size, program);
+    return true;
+}
+
+// Module scripts are named "NN_<name>" where NN is the adapter ID
+static bool parse_module_filename(const char* filename, uint8_t* id) {
+    size_t len = strlen(filename);
+    if (len < 4 || filename[0] < '0' || filename[0] > '9' || filename[1] < '0' || filename[1] > '9' || filename[2] != '_') {
+        return false;
+    }
+    if (len > 4 && strcmp(filename + len - 4, ".bck") == 0) {
+        return false;
+    }
+    *id = (filename[0] - '0') * 10 + (filename[1] - '0');
+    return *id < MODULE_ID_COUNT;
+}
+
+static void free_module_loads(module_load_t* loads, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(loads[i].program.ops);
+        free(loads[i].program.aliases);
+        free(loads[i].program.groups);
+    }
+    free(loads);
+}
+
+// Pack the loaded programs into a single allocation and install it
+static bool build_module_arena(const module_load_t* loads, size_t count) {
+    size_t ops_total = 0;
+    size_t aliases_total = 0;
+    size_t groups_total = 0;
+    size_t names_total = 0;
+    for (size_t i = 0; i < count; i++) {
+        ops_total += loads[i].program.count;
+        aliases_total += loads[i].program.alias_count;
+        groups_total += loads[i].program.group_count;
+        names_total += strlen(loads[i].name) + 1;
+    }
     
-    // Extract module name from filename (remove index prefix)
-    String module_name = module_filename.substring(3); // Skip "NN_" prefix
-    
-    ESP_LOGI(TAG, "Loading module: %s (ID: %zu)", module_name.c_str(), current_module_index);
-    
-    // Open the module file
-    String filepath = "/modules/" + module_filename;
-    file = LittleFS.open(filepath.c_str(), "r");
-    if (!file) {
-        ESP_LOGE(TAG, "Failed to open module file: %s", filepath.c_str());
+    // Largest alignment first so every section stays aligned
+    size_t arena_size = count * sizeof(module_info_t)
+                      + ops_total * sizeof(test_operation_t)
+                      + aliases_total * sizeof(test_alias_t)
+                      + groups_total * sizeof(test_group_t)
+                      + names_total;
+    uint8_t* arena = (uint8_t*)malloc(arena_size);
+    if (!arena) {
+        ESP_LOGE(TAG, "Failed to allocate %zu byte module arena", arena_size);
         return false;
     }
     
-    // First pass: count operations
-    size_t total_operations = 0;
-    file.seek(0);
+    module_info_t* arena_modules = (module_info_t*)arena;
+    test_operation_t* ops = (test_operation_t*)(arena_modules + count);
+    test_alias_t* aliases = (test_alias_t*)(ops + ops_total);
+    test_group_t* groups = (test_group_t*)(aliases + aliases_total);
+    char* names = (char*)(groups + groups_total);
     
-    while (file.available()) {
-        String line = file.readStringUntil('\n');
-        line.trim();
+    for (size_t i = 0; i < count; i++) {
+        const script_program_t& program = loads[i].program;
+        module_info_t* module = &arena_modules[i];
         
-        if (line.length() == 0 || line.startsWith("#")) {
-            continue;
+        if (program.count > 0) {
+            memcpy(ops, program.ops, program.count * sizeof(test_operation_t));
+        }
+        if (program.alias_count > 0) {
+            memcpy(aliases, program.aliases, program.alias_count * sizeof(test_alias_t));
         }
+        if (program.group_count > 0) {
+            memcpy(groups, program.groups, program.group_count * sizeof(test_group_t));
+        }
+        size_t name_size = strlen(loads[i].name) + 1;
+        memcpy(names, loads[i].name, name_size);
+        
+        module->id = loads[i].id;
+        module->name = names;
+        module->test_operations = ops;
+        module->test_operations_count = program.count;
+        module->test_results = nullptr; // Will be allocated when needed
+        module->aliases = aliases;
+        module->alias_count = program.alias_count;
+        module->groups = groups;
+        module->group_count = program.group_count;
+        module->retest_groups = program.retest_groups;
+        module->limits = program.limits;
         
-        total_operations++;
+        ops += program.count;
+        aliases += program.alias_count;
+        groups += program.group_count;
+        names += name_size;
     }
     
-    ESP_LOGD(TAG, "Found %zu operations", total_operations);
-    
-    // Allocate memory
-    if (operations_buffer) {
-        free(operations_buffer);
-    }
-    if (modules) {
-        free(modules);
+    // Replace the previously loaded modules
+    free(module_arena);
+    module_arena = arena;
+    modules = arena_modules;
+    modules_count = count;
+    memset(module_by_id, -1, sizeof(module_by_id));
+    for (size_t i = 0; i < count; i++) {
+        module_by_id[modules[i].id] = i;
     }
     
-    operations_buffer = (test_operation_t*)malloc(total_operations * sizeof(test_operation_t));
-    modules = (module_info_t*)malloc(1 * sizeof(module_info_t));
+    ESP_LOGI(TAG, "Module arena: %zu modules, %zu operations, %zu aliases in %zu bytes",
+             count, ops_total, aliases_total, arena_size);
+    return true;
+}
+
+bool init_modules_from_fs() {
+    ESP_LOGD(TAG, "Initializing modules from filesystem");
+    uint32_t start_time = millis();
     
-    if (!operations_buffer || !modules) {
-        ESP_LOGE(TAG, "Failed to allocate memory for module");
-        file.close();
+    if (!LittleFS.begin(true)) {
+        ESP_LOGE(TAG, "Failed to mount LittleFS");
         return false;
     }
     
-    modules_count = 1;
-    operations_buffer_size = total_operations;
-    
-    // Initialize the single module
-    module_info_t* current_module = &modules[0];
-    current_module->id = current_module_index;
-    current_module->name = strdup(module_name.c_str());
-    current_module->test_operations = operations_buffer;
-    current_module->test_operations_count = 0;
-    current_module->test_results = nullptr; // Will be allocated when needed
-    current_module->loop_start = -1;
-    current_module->loop_end = -1;
+    File dir = LittleFS.open("/modules");
+    if (!dir || !dir.isDirectory()) {
+        ESP_LOGE(TAG, "Failed to open /modules directory");
+        return false;
+    }
     
-    // Second pass: parse operations
-    file.seek(0);
-    size_t operation_index = 0;
+    module_load_t* loads = (module_load_t*)calloc(MODULE_ID_COUNT, sizeof(module_load_t));
+    if (!loads) {
+        ESP_LOGE(TAG, "Failed to allocate memory for modules");
+        dir.close();
+        return false;
+    }
     
-    while (file.available()) {
-        String line = file.readStringUntil('\n');
-        line.trim();
-        
-        if (line.length() == 0 || line.startsWith("#")) {
-            continue;
-        }
-        
-        // Parse operation line
-        const char* line_str = line.c_str();
-        char token[64];
-        test_operation_t& op = operations_buffer[operation_index];
-        
-        // Check for repeat flag (+ at end of line)
-        bool repeat_flag = false;
-        if (line.endsWith("+")) {
-            repeat_flag = true;
-            line = line.substring(0, line.length() - 1); // Remove the +
-            line_str = line.c_str();
-        }
-        
-        line_str = get_token(line_str, token, sizeof(token));
+    size_t count = 0;
+    bool loaded_ids[MODULE_ID_COUNT] = {};
+    File file = dir.openNextFile();
+    while (file) {
+        char module_filename[64];
+        strlcpy(module_filename, file.name(), sizeof(module_filename));
+        file.close();
         
-        if (strcmp(token, "{") == 0) {
-            // Loop start marker
-            current_module->loop_start = operation_index;
-            ESP_LOGI(TAG, "Loop start at operation %zu", operation_index);
-            continue;
-            
-        } else if (strcmp(token, "}") == 0) {
-            // Loop end marker
-            current_module->loop_end = operation_index - 1;
-            ESP_LOGI(TAG, "Loop end at operation %zu", operation_index - 1);
-            continue;
-            
-        } else if (strcmp(token, "src") == 0) {
-            op.op = TEST_OP_SOURCE;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = string_to_source(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = atoi(token);
-            op.arg2 = 0;
-            
-        } else if (strcmp(token, "src_sig") == 0) {
-            op.op = TEST_OP_SOURCE_SIG;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = string_to_source(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = atoi(token); // Frequency in Hz
-            op.arg2 = 0;
-            
-        } else if (strcmp(token, "io") == 0) {
-            op.op = TEST_OP_IO;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = atoi(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = string_to_io_state(token);
-            op.arg2 = 0;
-            
-        } else if (strcmp(token, "iolevel") == 0) {
-            op.op = TEST_OP_CHECK_IO_LEVEL;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = atoi(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            // h = HIGH = 1, l = LOW = 0
-            op.arg1 = (strcmp(token, "h") == 0) ? 1 : 0;
-            op.arg2 = 0;
-            
-        } else if (strcmp(token, "pd") == 0) {
-            op.op = TEST_OP_SINK_PD;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = 0; // Assuming PIN_SINK_PD_A
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = (strcmp(token, "p") == 0) ? 1 : 0;
-            op.arg2 = 0;
-            
-        } else if (strcmp(token, "i") == 0) {
-            op.op = TEST_OP_CHECK_CURRENT;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = string_to_current_rail(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = atoi(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg2 = atoi(token);
-            
-        } else if (strcmp(token, "v") == 0) {
-            op.op = TEST_OP_CHECK_PIN;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = string_to_voltage_pin(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = atoi(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg2 = atoi(token);
-            
-        } else if (strcmp(token, "reset") == 0) {
-            op.op = TEST_OP_RESET;
-            op.repeat = repeat_flag;
-            op.pin = 0;  // Not used for reset
-            op.arg1 = 0; // Not used for reset
-            op.arg2 = 0; // Not used for reset
-            
-        } else if (strcmp(token, "scope") == 0) {
-            op.op = TEST_OP_SCOPE;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = string_to_voltage_pin(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = atoi(token); // Sample frequency
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg2 = atoi(token); // Buffer size
-            
-        } else if (strcmp(token, "min") == 0) {
-            op.op = TEST_OP_CHECK_MIN;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = string_to_voltage_pin(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = atoi(token); // Low value
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg2 = atoi(token); // High value
-            
-        } else if (strcmp(token, "max") == 0) {
-            op.op = TEST_OP_CHECK_MAX;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = string_to_voltage_pin(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = atoi(token); // Low value
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg2 = atoi(token); // High value
-            
-        } else if (strcmp(token, "avg") == 0) {
-            op.op = TEST_OP_CHECK_AVG;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = string_to_voltage_pin(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = atoi(token); // Low value
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg2 = atoi(token); // High value
-            
-        } else if (strcmp(token, "freq") == 0) {
-            op.op = TEST_OP_CHECK_FREQ;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = string_to_voltage_pin(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = atoi(token); // Low value
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg2 = atoi(token); // High value
-            
-        } else if (strcmp(token, "amplitude") == 0) {
-            op.op = TEST_OP_CHECK_AMPLITUDE;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.pin = string_to_voltage_pin(token);
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = atoi(token); // Low value
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg2 = atoi(token); // High value
-            
-        } else if (strcmp(token, "delay") == 0) {
-            op.op = TEST_OP_DELAY;
-            op.repeat = repeat_flag;
-            
-            line_str = get_token(line_str, token, sizeof(token));
-            op.arg1 = atoi(token); // Timeout in milliseconds
-            op.pin = 0;  // Not used for delay
-            op.arg2 = 0; // Not used for delay
-            
+        uint8_t id;
+        if (!parse_module_filename(module_filename, &id)) {
+            ESP_LOGD(TAG, "Skipping %s", module_filename);
+        } else if (loaded_ids[id]) {
+            ESP_LOGW(TAG, "Duplicate module ID %u, skipping %s", id, module_filename);
         } else {
-            ESP_LOGW(TAG, "Unknown operation: %s", token);
-            continue;
+            module_load_t* load = &loads[count];
+            if (!load_module_program(module_filename, &load->program)) {
+                free_module_loads(loads, count);
+                dir.close();
+                return false;
+            }
+            load->id = id;
+            strlcpy(load->name, module_filename + 3, sizeof(load->name)); // Skip "NN_" prefix
+            loaded_ids[id] = true;
+            count++;
         }
         
-        operation_index++;
-        current_module->test_operations_count++;
+        file = dir.openNextFile();
     }
+    dir.close();
     
-    file.close();
+    bool built = build_module_arena(loads, count);
+    free_module_loads(loads, count);
+    if (!built) {
+        return false;
+    }
     
-    ESP_LOGI(TAG, "Successfully loaded module '%s' (ID: %zu) with %zu operations", 
-             current_module->name, current_module->id, current_module->test_operations_count);
+    ESP_LOGI(TAG, "Loaded %zu modules in %lu ms", modules_count, millis() - start_time);
     return true;
 }
 
-module_info_t* get_current_module_info() {
+void request_modules_reload() {
+    modules_reload_requested = true;
+}
+
+bool reload_modules_if_requested() {
+    if (!modules_reload_requested) {
+        return true;
+    }
+    // Cleared first so a script saved during the rebuild triggers another one
+    modules_reload_requested = false;
+    ESP_LOGI(TAG, "Reloading module scripts");
+    return init_modules_from_fs();
+}
+
+module_info_t* get_module_info(size_t id) {
     if (!modules) {
         ESP_LOGE(TAG, "Modules not initialized");
         return nullptr;
     }
     
-    for (size_t i = 0; i < modules_count; i++) {
-        if (modules[i].id == current_module_index) {
-            return &modules[i];
-        }
+    if (id >= MODULE_ID_COUNT || module_by_id[id] < 0) {
+        ESP_LOGW(TAG, "Module with ID %zu not found", id);
+        return nullptr;
     }
     
-    ESP_LOGW(TAG, "Module with ID %d not found", current_module_index);
-    return nullptr;
+    return &modules[module_by_id[id]];
+}
+
+module_info_t* get_current_module_info() {
+    return get_module_info(current_module_index);
 }
 
 module_info_t* get_modules_array() {
@@ -439,7 +491,71 @@ size_t get_modules_count() {
     return modules_count;
 }
 
-bool execute_module_tests(module_info_t* module) {
+const char* get_operation_pin_name(const module_info_t* module, const test_operation_t& op, char* buf, size_t size) {
+    if (module && op.alias >= 0 && (size_t)op.alias < module->alias_count) {
+        return module->aliases[op.alias].name;
+    }
+
+    switch (script_op_args(op.op)) {
+        case SCRIPT_ARGS_SOURCE_VALUE:
+        case SCRIPT_ARGS_SOURCE_SIGNAL:
+        case SCRIPT_ARGS_SOURCE_WAVE:
+        case SCRIPT_ARGS_SOURCE_CAL:
+        case SCRIPT_ARGS_SWEEP:
+            return script_source_name((source_net_t)op.pin);
+        case SCRIPT_ARGS_SINK_RANGE:
+        case SCRIPT_ARGS_SINK_LIST:
+        case SCRIPT_ARGS_SINK_SETTLE:
+            return script_sink_name((ADC_sink_t)op.pin);
+        case SCRIPT_ARGS_RAIL_RANGE:
+        case SCRIPT_ARGS_RAIL_SETTLE:
+            return script_rail_name((current_rail_t)op.pin);
+        case SCRIPT_ARGS_IO_STATE:
+        case SCRIPT_ARGS_IO_LEVEL:
+            snprintf(buf, size, "%d", op.pin);
+            return buf;
+        case SCRIPT_ARGS_IO_PORT:
+        case SCRIPT_ARGS_IO_LEVELS: {
+            // First pin to the highest pin the op touches
+            int last = op.pin;
+            for (int pin = op.pin; pin < 16; pin++) {
+                if (op.arg2 & (1 << pin)) last = pin;
+            }
+            snprintf(buf, size, "%d-%d", op.pin, last);
+            return buf;
+        }
+        default:
+            return nullptr;
+    }
+}
+
+// Groups never split a loop, so the last group starting at or before an operation holds it
+static int find_operation_group(const module_info_t* module, size_t op_index) {
+    int found = -1;
+    for (size_t i = 0; i < module->group_count && module->groups[i].first_op <= op_index; i++) {
+        if (op_index < module->groups[i].end_op) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+// Last group named "setup" before the given group, or -1
+static int find_setup_group(const module_info_t* module, int before) {
+    for (int i = before - 1; i >= 0; i--) {
+        if (strcasecmp(module->groups[i].name, "setup") == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const test_group_t* get_operation_group(const module_info_t* module, size_t op_index) {
+    int index = find_operation_group(module, op_index);
+    return index >= 0 ? &module->groups[index] : nullptr;
+}
+
+bool execute_module_tests(module_info_t* module, bool retest) {
     if (!module) {
         ESP_LOGE(TAG, "Module info is null");
         return false;
@@ -457,7 +573,33 @@ bool execute_module_tests(module_info_t* module) {
             return false;
         }
         
-        bool success = execute_test_sequence(module->test_operations, module->test_operations_count, global_results, module->loop_start, module->loop_end);
+        running_module = module;
+        // One deadline for the whole run, a retest's setup replay counts against it
+        uint32_t script_start = millis();
+        size_t begin = 0;
+        size_t failed_pc = 0;
+        bool success = true;
+
+        // Groups that passed keep their results, only the failed one runs again after its setup
+        if (retest && module->retest_groups && failed_group >= 0) {
+            const test_group_t& group = module->groups[failed_group];
+            int setup = find_setup_group(module, failed_group);
+            if (setup >= 0) {
+                const test_group_t& setup_group = module->groups[setup];
+                ESP_LOGI(TAG, "Re-running setup group '%s'", setup_group.name);
+                success = execute_test_sequence(module->test_operations, setup_group.first_op, setup_group.end_op,
+                                                global_results, module->limits, script_start, &failed_pc);
+            }
+            ESP_LOGI(TAG, "Retesting from group '%s'", group.name);
+            begin = group.first_op;
+        }
+
+        if (success) {
+            success = execute_test_sequence(module->test_operations, begin, module->test_operations_count,
+                                            global_results, module->limits, script_start, &failed_pc);
+        }
+        failed_group = success ? -1 : find_operation_group(module, failed_pc);
+        running_module = nullptr;
 
         ESP_LOGI(TAG, "=== Test %s results for module: %s ===", success ? "PASSED" : "FAILED", module->name);
         
@@ -468,206 +610,343 @@ bool execute_module_tests(module_info_t* module) {
     return false;
 }
 
-static bool execute_test_sequence(const test_operation_t* operations, size_t count, test_operation_result_t* results, int loop_start, int loop_end) {
-    ESP_LOGD(TAG, "Executing test sequence with %zu operations (loop: %d to %d)", count, loop_start, loop_end);
+// Wait out a deferred delay window before op, unless op may run inside it
+static void wait_pending_delay(delay_window_t* window, const test_operation_t* op) {
+    uint32_t left = delay_window_wait(window, op, millis());
+    if (left > 0) {
+        delay(left);
+    }
+}
 
-    // Determine the range of operations to execute
-    size_t before_loop_end = (loop_start >= 0) ? loop_start : count;
-    size_t after_loop_start = (loop_end >= 0) ? loop_end + 1 : count;
-    
-    // Execute operations before the loop
-    for (size_t i = 0; i < before_loop_end; i++) {
-        ESP_LOGD(TAG, "Start of operation %d", i);
-        const test_operation_t& op = operations[i];
-        bool result = false;
-        int32_t actual_result = 0;
-        
-        // Handle repeatable operations using TEST_RUN_REPEAT logic
-        if (op.repeat) {
-            do {
-                uint32_t start_time = millis();
-                result = execute_single_operation(op, &actual_result);
-                results[i].execution_time_ms = millis() - start_time;
-                if(!results[i].passed) {
-                    results[i].passed = result;
-                    results[i].result = actual_result;
-                }
-                if (!result) {
-                    if (get_power_rails_state(NULL, NULL, NULL) != POWER_RAILS_ALL) {
-                        ESP_LOGD(TAG, "Power rails disconnected during repeatable operation");
-                        return false;
-                    }
-                    delay(10);
-                }
-            } while (!result);
-        } else {
-            uint32_t start_time = millis();
-            result = execute_single_operation(op, &actual_result);
-            results[i].execution_time_ms = millis() - start_time;
-            if(!results[i].passed) {
-                results[i].passed = result;
-                results[i].result = actual_result;
+// True once ms milliseconds have passed since start, never for a zero limit
+static bool deadline_passed(uint32_t start, uint32_t ms) {
+    return ms > 0 && millis() - start >= ms;
+}
+
+// Check one vmulti operation. The first of a run of consecutive vmulti operations
+// samples all their sinks in one interleaved sweep, the rest reuse its readings.
+// Retries, loop iterations and anything run in between take a fresh sweep.
+static bool check_swept_pin(const test_operation_t* operations, size_t pc, size_t end, pin_sweep_t* sweep,
+                            bool fresh, int32_t* result) {
+    char pin_buf[8];
+    if (fresh || pc != sweep->next || pc >= sweep->end) {
+        ADC_sink_t sinks[ADC_sink_count];
+        size_t count = 0;
+        while (pc + count < end && count < ADC_sink_count && operations[pc + count].op == TEST_OP_CHECK_PIN_MULTI) {
+            sinks[count] = (ADC_sink_t)operations[pc + count].pin;
+            count++;
+        }
+        hal_adc_read_multi(sinks, count, sweep->millivolts);
+        sweep->first = pc;
+        sweep->end = pc + count;
+
+        // One log line for the whole sweep
+        char line[160];
+        int len = snprintf(line, sizeof(line), "Swept voltages:");
+        for (size_t j = 0; j < count && len < (int)sizeof(line); j++) {
+            const char* name = get_operation_pin_name(running_module, operations[pc + j], pin_buf, sizeof(pin_buf));
+            len += snprintf(line + len, sizeof(line) - len, " %s=%ld", name ? name : "?", (long)sweep->millivolts[j]);
+        }
+        ESP_LOGI(TAG, "%s mV", line);
+    }
+    sweep->next = pc + 1;
+
+    const test_operation_t& op = operations[pc];
+    int32_t millivolts = sweep->millivolts[pc - sweep->first];
+    bool passed = millivolts >= op.arg1 && millivolts <= op.arg2;
+    if (result) {
+        *result = millivolts;
+    }
+    if (!passed) {
+        const char* pin_name = get_operation_pin_name(running_module, op, pin_buf, sizeof(pin_buf));
+        ESP_LOGW(TAG, "%s voltage: %ld mV OUT OF RANGE (acceptable range: %ld-%ld mV)",
+                 pin_name ? pin_name : "?", (long)millivolts, (long)op.arg1, (long)op.arg2);
+    }
+    return passed;
+}
+
+// Run the program with a single program counter. Loop markers push and pop
+// frames; a failed operation aborts the sequence unless it runs inside an
+// infinite loop, which keeps cycling until the module is removed or the
+// script deadline, counted from script_start, passes. Runs operations
+// [begin, end), which must not cut through a loop; on failure *failed_pc is
+// the operation that failed.
+static bool execute_test_sequence(const test_operation_t* operations, size_t begin, size_t end, test_operation_result_t* results,
+                                  const test_limits_t& limits, uint32_t script_start, size_t* failed_pc) {
+    ESP_LOGD(TAG, "Executing test sequence, operations %zu to %zu", begin, end);
+
+    loop_frame_t frames[SCRIPT_LOOP_DEPTH_MAX];
+    size_t depth = 0;
+    size_t infinite_depth = 0;  // Open loops without an iteration or time limit
+    bool success = true;
+    size_t pc = begin;
+
+    // A delay only has to separate the operations around it. It is turned into a
+    // deadline the next operation waits for, so the inter-op gap, logging and
+    // consecutive delays run inside the window instead of after it. So do the
+    // checks script_op_runs_in_delay() allows: sweep results and "&" checks.
+    delay_window_t window = {false, 0};
+
+    pin_sweep_t sweep = {0, 0, 0, {0}};
+
+    while (pc < end) {
+        const test_operation_t& op = operations[pc];
+        *failed_pc = pc;
+
+        if (deadline_passed(script_start, limits.deadline_ms)) {
+            // Charge the timeout to the operation that would have run next
+            size_t at = pc;
+            while (at < end && script_op_is_control(operations[at].op)) at++;
+            if (at < end) {
+                results[at].passed = false;
+                results[at].status = TEST_STATUS_TIMEOUT;
             }
-            if (!result) {
-                return false;
+            ESP_LOGW(TAG, "Script deadline of %lu ms reached before operation %zu", limits.deadline_ms, at);
+            *failed_pc = at;
+            return false;
+        }
+
+        if (op.op == TEST_OP_LOOP_START) {
+            loop_frame_t& frame = frames[depth++];
+            frame.remaining = op.arg1;
+            frame.start_ms = millis();
+            if (op.arg1 == 0 && op.arg2 == 0) {
+                infinite_depth++;
             }
+            results[pc].passed = true;
+            results[pc].status = TEST_STATUS_OK;
+            ESP_LOGI(TAG, "Entering loop: operations %zu to %d", pc + 1, op.pin - 1);
+            pc++;
+            continue;
         }
-        
-        // Small delay between operations
-        delay(1);
-    }
-    
-    // Execute loop operations indefinitely if loop is defined
-    if (loop_start >= 0 && loop_end >= 0 && loop_start <= loop_end) {
-        ESP_LOGI(TAG, "Entering infinite loop: operations %d to %d", loop_start, loop_end);
-        
-        while (true) {
-            // Check if module is still connected
+
+        if (op.op == TEST_OP_DELAY) {
+            // Back-to-back delays add up, as they would when run one after the other
+            delay_window_add(&window, millis(), op.arg1);
+            ESP_LOGI(TAG, "Executing delay operation: %d ms", op.arg1);
+            results[pc].passed = true;
+            results[pc].status = TEST_STATUS_OK;
+            results[pc].execution_time_ms = op.arg1;
+            pc++;
+            continue;
+        }
+
+        if (op.op == TEST_OP_LOOP_END) {
+            const test_operation_t& start = operations[op.pin];
+            loop_frame_t& frame = frames[depth - 1];
+            results[pc].passed = true;
+            results[pc].status = TEST_STATUS_OK;
+
+            // Timed loops count the delays of their body
+            wait_pending_delay(&window, nullptr);
+
             if (get_power_rails_state(NULL, NULL, NULL) != POWER_RAILS_ALL) {
                 ESP_LOGI(TAG, "Module removed, exiting loop");
                 return false;
             }
-            
-            // Execute operations in the loop
-            for (size_t i = loop_start; i <= (size_t)loop_end; i++) {
-                ESP_LOGD(TAG, "Loop: executing operation %d", i);
-                const test_operation_t& op = operations[i];
-                bool result = false;
-                int32_t actual_result = 0;
-                
-                // For loop operations, always continue regardless of result
-                uint32_t start_time = millis();
-                result = execute_single_operation(op, &actual_result);
-                results[i].execution_time_ms = millis() - start_time;
-                if(!results[i].passed) {
-                    results[i].passed = result;
-                    results[i].result = actual_result;
-                }
-                
-                // Check module connection after each operation
-                if (get_power_rails_state(NULL, NULL, NULL) != POWER_RAILS_ALL) {
-                    ESP_LOGI(TAG, "Module removed during loop, exiting");
-                    return false;
-                }
-                
-                // Small delay between operations
-                delay(1);
+
+            bool again;
+            if (start.arg1 > 0) {
+                again = --frame.remaining > 0;
+            } else if (start.arg2 > 0) {
+                again = !deadline_passed(frame.start_ms, start.arg2);
+            } else {
+                again = true;
+            }
+
+            if (again) {
+                pc = op.pin + 1;
+            } else {
+                depth--;
+                pc++;
             }
+            continue;
         }
-    }
-    
-    // Execute operations after the loop (if any)
-    for (size_t i = after_loop_start; i < count; i++) {
-        ESP_LOGD(TAG, "Start of operation %d", i);
-        const test_operation_t& op = operations[i];
-        bool result = false;
+
+        if (window.pending && script_op_runs_in_delay(op)) {
+            ESP_LOGD(TAG, "Operation %zu runs inside the delay window", pc);
+        }
+        wait_pending_delay(&window, &op);
+        ESP_LOGD(TAG, "Start of operation %zu", pc);
         int32_t actual_result = 0;
-        
-        // Handle repeatable operations using TEST_RUN_REPEAT logic
-        if (op.repeat) {
-            do {
-                uint32_t start_time = millis();
-                result = execute_single_operation(op, &actual_result);
-                results[i].execution_time_ms = millis() - start_time;
-                if(!results[i].passed) {
-                    results[i].passed = result;
-                    results[i].result = actual_result;
-                }
-                if (!result) {
-                    if (get_power_rails_state(NULL, NULL, NULL) != POWER_RAILS_ALL) {
-                        ESP_LOGD(TAG, "Power rails disconnected during repeatable operation");
-                        return false;
-                    }
-                    delay(10);
-                }
-            } while (!result);
-        } else {
+        bool passed;
+        test_status_t status;
+        uint32_t retry_timeout = op.timeout_ms ? op.timeout_ms : limits.retry_timeout_ms;
+        uint32_t backoff = limits.backoff_ms;
+        uint32_t op_start = millis();
+        bool retry = false;
+        while (true) {
             uint32_t start_time = millis();
-            result = execute_single_operation(op, &actual_result);
-            results[i].execution_time_ms = millis() - start_time;
-            if(!results[i].passed) {
-                results[i].passed = result;
-                results[i].result = actual_result;
+            if (op.op == TEST_OP_CHECK_PIN_MULTI) {
+                passed = check_swept_pin(operations, pc, end, &sweep, retry, &actual_result);
+            } else {
+                passed = execute_single_operation(op, &actual_result);
+            }
+            results[pc].execution_time_ms = millis() - start_time;
+            status = passed ? TEST_STATUS_OK : (take_wait_timeout() ? TEST_STATUS_TIMEOUT : TEST_STATUS_FAIL);
+            // "+" operations are retried until they pass, their deadline passes or the module is removed
+            if (passed || !op.repeat) {
+                break;
             }
-            if (!result) {
+            if (get_power_rails_state(NULL, NULL, NULL) != POWER_RAILS_ALL) {
+                ESP_LOGD(TAG, "Power rails disconnected during repeatable operation");
                 return false;
             }
+            if (deadline_passed(op_start, retry_timeout) || deadline_passed(script_start, limits.deadline_ms)) {
+                ESP_LOGW(TAG, "Operation %zu still failing after %lu ms of retries", pc, millis() - op_start);
+                status = TEST_STATUS_TIMEOUT;
+                break;
+            }
+            delay(backoff);
+            backoff = min(backoff * 2, limits.backoff_max_ms);
+            retry = true;
         }
-        
-        // Small delay between operations
-        delay(1);
+
+        if (!results[pc].passed) {
+            results[pc].passed = passed;
+            results[pc].status = status;
+            results[pc].result = actual_result;
+        }
+
+        if (!passed) {
+            if (infinite_depth == 0) {
+                // A check run inside a delay window can fail before the window ends
+                wait_pending_delay(&window, nullptr);
+                return false;
+            }
+            success = false;
+        }
+
+        // Check module connection after each operation inside a loop
+        if (depth > 0 && get_power_rails_state(NULL, NULL, NULL) != POWER_RAILS_ALL) {
+            ESP_LOGI(TAG, "Module removed during loop, exiting");
+            return false;
+        }
+
+        // Small delay between operations, checks served by the same sweep need none
+        if (op.op != TEST_OP_CHECK_PIN_MULTI || pc + 1 >= sweep.end) {
+            delay(1);
+        }
+        pc++;
     }
 
-    return true;
+    // A trailing delay still separates this range from whatever the caller runs next
+    wait_pending_delay(&window, nullptr);
+    return success;
 }
 
 // Helper function to execute a single test operation
 static bool execute_single_operation(const test_operation_t& op, int32_t* result) {
     // ESP_LOGI(TAG, "Start of execute_single_operation: %d", op.op);
+    char pin_buf[8];
+    const char* pin_name = get_operation_pin_name(running_module, op, pin_buf, sizeof(pin_buf));
     switch (op.op) {
         case TEST_OP_SOURCE: {
-            ESP_LOGI(TAG, "Setting source %d to %d mV", op.pin, op.arg1);
+            ESP_LOGI(TAG, "Setting source %s to %d mV", pin_name, op.arg1);
             hal_set_source((source_net_t)op.pin, op.arg1);
             return true;
         }
         
         case TEST_OP_SOURCE_SIG: {
-            ESP_LOGI(TAG, "Starting signal generator on source %d with frequency %d Hz", op.pin, op.arg1);
-            hal_start_signal((source_net_t)op.pin, (float)op.arg1);
+            signal_wave_t wave;
+            wave.shape = (signal_shape_t)SIGNAL_ARG2_SHAPE(op.arg2);
+            wave.amplitude_mv = SIGNAL_ARG2_AMPLITUDE(op.arg2);
+            wave.offset_mv = op.arg3;
+            wave.duty = SIGNAL_ARG2_DUTY(op.arg2);
+            ESP_LOGI(TAG, "Starting signal generator on source %s: %s %ld.%03ld Hz, %ld mV, offset %ld mV, duty %d%%",
+                     pin_name, script_signal_shape_name(wave.shape), (long)(op.arg1 / 1000), (long)(op.arg1 % 1000),
+                     (long)wave.amplitude_mv, (long)wave.offset_mv, wave.duty);
+            hal_start_signal((source_net_t)op.pin, op.arg1 / 1000.0, &wave);
             return true;
         }
         
+        case TEST_OP_SOURCE_WAVE: {
+            bool started = hal_start_wave((source_net_t)op.pin, (uint32_t)op.arg1, op.arg2, op.arg3 != 0);
+            if (started) {
+                ESP_LOGI(TAG, "Playing wave %s on source %s at %d Hz%s", wave_name((source_net_t)op.pin), pin_name,
+                         op.arg2, op.arg3 ? ", looped" : "");
+            } else {
+                ESP_LOGE(TAG, "Failed to play wave %08lx on source %s", (unsigned long)op.arg1, pin_name);
+            }
+            return started;
+        }
+
         case TEST_OP_IO: {
-            ESP_LOGI(TAG, "Setting IO pin %d to %d", op.pin, op.arg1);
+            ESP_LOGI(TAG, "Setting IO pin %s to %d", pin_name, op.arg1);
             hal_set_io((mcp_io_t)op.pin, (io_state_t)op.arg1);
             return true;
         }
         
         case TEST_OP_CHECK_IO_LEVEL: {
             const char* expected_level = (op.arg1 == 1) ? "HIGH" : "LOW";
-            return check_io_level((mcp_io_t)op.pin, op.arg1, expected_level, result);
+            return check_io_level((mcp_io_t)op.pin, op.arg1, pin_name, expected_level, result);
+        }
+        
+        case TEST_OP_IO_PORT: {
+            ESP_LOGI(TAG, "Setting IO pins %s", pin_name);
+            hal_set_io_port(op.arg2 & 0xFFFF, op.arg1, (uint32_t)op.arg2 >> 16);
+            return true;
+        }
+        
+        case TEST_OP_CHECK_IO_LEVELS: {
+            return check_io_levels(op.arg2 & 0xFFFF, op.arg1, pin_name, result);
         }
         
         case TEST_OP_SINK_PD: {
             // Assuming PIN_SINK_PD_A is the pin for sink pulldown
             ESP_LOGI(TAG, "Setting sink pulldown on pin %d to %d", op.pin, op.arg1);
-            mcp1.pinMode(PIN_SINK_PD_A, OUTPUT);
-            mcp1.digitalWrite(PIN_SINK_PD_A, op.arg1 ? HIGH : LOW);
+            mcp1.setPinLevel(PIN_SINK_PD_A, op.arg1 ? HIGH : LOW);
+            mcp1.setPinMode(PIN_SINK_PD_A, OUTPUT);
+            mcp1.flush();
             return true;
         }
         
         case TEST_OP_CHECK_CURRENT: {
             range_t range = {op.arg1, op.arg2};
-            int mapped_pin = map_current_pin(op.pin);
-            const char* rail_name = (mapped_pin == PIN_INA_12V) ? "+12V" : 
-                                   (mapped_pin == PIN_INA_5V) ? "+5V" : "-12V";
-            return check_current((ina_pin_t)mapped_pin, range, rail_name, result);
+            return check_current((ina_pin_t)map_current_pin(op.pin), range, pin_name, result);
         }
         
         case TEST_OP_CHECK_PIN: {
             range_t range = {op.arg1, op.arg2};
-            const char* pin_name = (op.pin == ADC_sink_1k_A) ? "A" :
-                                  (op.pin == ADC_sink_1k_B) ? "B" :
-                                  (op.pin == ADC_sink_1k_C) ? "C" :
-                                  (op.pin == ADC_sink_1k_D) ? "D" :
-                                  (op.pin == ADC_sink_1k_E) ? "E" :
-                                  (op.pin == ADC_sink_1k_F) ? "F" :
-                                  (op.pin == ADC_sink_PD_A) ? "pdA" :
-                                  (op.pin == ADC_sink_PD_B) ? "pdB" :
-                                  (op.pin == ADC_sink_PD_C) ? "pdC" :
-                                  (op.pin == ADC_sink_Z_D) ? "zD" :
-                                  (op.pin == ADC_sink_Z_E) ? "zE" :
-                                  (op.pin == ADC_sink_Z_F) ? "zF" : "Unknown";
             return test_pin_range((ADC_sink_t)op.pin, range, pin_name, result);
         }
         
+        case TEST_OP_CHECK_PIN_MULTI: {
+            // Normally served by check_swept_pin(), on its own it is a plain voltage check
+            range_t range = {op.arg1, op.arg2};
+            return test_pin_range((ADC_sink_t)op.pin, range, pin_name, result);
+        }
+        
+        case TEST_OP_SETTLE: {
+            // A timeout is only a warning, the checks that follow decide
+            settle_pin((ADC_sink_t)op.pin, op.arg1, op.arg2, pin_name, result);
+            return true;
+        }
+        
+        case TEST_OP_CALIBRATE_SOURCE: {
+            int32_t error_mv;
+            bool calibrated = hal_source_calibrate((source_net_t)op.pin, (ADC_sink_t)op.arg1, &error_mv);
+            bool error_ok = calibrated && error_mv <= op.arg2;
+            ESP_LOGI(TAG, "Source %s calibrated via %s: max error %d mV %s (limit: %d mV)", pin_name,
+                     script_sink_name((ADC_sink_t)op.arg1), error_mv, error_ok ? "OK" : "FAIL", op.arg2);
+            if (result) {
+                *result = error_mv;
+            }
+            return error_ok;
+        }
+        
+        case TEST_OP_SETTLE_CURRENT: {
+            settle_current((ina_pin_t)map_current_pin(op.pin), op.arg1, op.arg2, pin_name, result);
+            return true;
+        }
+        
         case TEST_OP_RESET: {
             ESP_LOGI(TAG, "Executing reset operation");
             return execute_reset_operation();
         }
         
         case TEST_OP_SCOPE: {
-            ESP_LOGI(TAG, "Starting Sigscoper on pin %d with frequency %d and buffer size %d", op.pin, op.arg1, op.arg2);
+            ESP_LOGI(TAG, "Starting Sigscoper on pin %s with frequency %d and buffer size %d", pin_name, op.arg1, op.arg2);
             return start_sigscoper((ADC_sink_t)op.pin, op.arg1, op.arg2);
         }
         
@@ -676,7 +955,7 @@ static bool execute_single_operation(const test_operation_t& op, int32_t* result
             if (result) {
                 *result = 0; // Initialize result
             }
-            return check_signal_min((ADC_sink_t)op.pin, range, result);
+            return check_signal_min((ADC_sink_t)op.pin, range, pin_name, result);
         }
         
         case TEST_OP_CHECK_MAX: {
@@ -684,7 +963,7 @@ static bool execute_single_operation(const test_operation_t& op, int32_t* result
             if (result) {
                 *result = 0; // Initialize result
             }
-            return check_signal_max((ADC_sink_t)op.pin, range, result);
+            return check_signal_max((ADC_sink_t)op.pin, range, pin_name, result);
         }
         
         case TEST_OP_CHECK_AVG: {
@@ -692,7 +971,7 @@ static bool execute_single_operation(const test_operation_t& op, int32_t* result
             if (result) {
                 *result = 0; // Initialize result
             }
-            return check_signal_avg((ADC_sink_t)op.pin, range, result);
+            return check_signal_avg((ADC_sink_t)op.pin, range, pin_name, result);
         }
         
         case TEST_OP_CHECK_FREQ: {
@@ -700,7 +979,7 @@ static bool execute_single_operation(const test_operation_t& op, int32_t* result
             if (result) {
                 *result = 0; // Initialize result
             }
-            return check_signal_freq((ADC_sink_t)op.pin, range, result);
+            return check_signal_freq((ADC_sink_t)op.pin, range, pin_name, result);
         }
         
         case TEST_OP_CHECK_AMPLITUDE: {
@@ -708,7 +987,30 @@ static bool execute_single_operation(const test_operation_t& op, int32_t* result
             if (result) {
                 *result = 0; // Initialize result
             }
-            return check_signal_amplitude((ADC_sink_t)op.pin, range, result);
+            return check_signal_amplitude((ADC_sink_t)op.pin, range, pin_name, result);
+        }
+        
+        case TEST_OP_SWEEP: {
+            ADC_sink_t sink = (ADC_sink_t)SWEEP_ARG1_SINK(op.arg1);
+            int points = SWEEP_ARG1_POINTS(op.arg1);
+            ESP_LOGI(TAG, "Sweeping source %s into %s: %ld.%03ld..%ld.%03ld Hz, %d points", pin_name, script_sink_name(sink),
+                     (long)(op.arg2 / 1000), (long)(op.arg2 % 1000), (long)(op.arg3 / 1000), (long)(op.arg3 % 1000), points);
+            return run_freq_sweep((source_net_t)op.pin, sink, op.arg2, op.arg3, points, script_sink_name(sink), result);
+        }
+        
+        case TEST_OP_CHECK_CUTOFF: {
+            range_t range = {op.arg1, op.arg2};
+            return check_sweep_cutoff((ADC_sink_t)op.pin, range, pin_name, result);
+        }
+        
+        case TEST_OP_CHECK_SLOPE: {
+            range_t range = {op.arg1, op.arg2};
+            return check_sweep_slope((ADC_sink_t)op.pin, range, pin_name, result);
+        }
+        
+        case TEST_OP_CHECK_PEAK: {
+            range_t range = {op.arg1, op.arg2};
+            return check_sweep_peak((ADC_sink_t)op.pin, range, pin_name, result);
         }
         
         case TEST_OP_DELAY: {
@@ -0,0 +1,1189 @@
+#include "script_parser.h"
+#include "script_registry.h"
+#include "freq_sweep.h"
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdarg>
+#include <cstdint>
+
+#ifdef ARDUINO
+#include "esp_log.h"
+#else
+// Host builds (tools/) run the parser without ESP logging
+#define ESP_LOGE(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGW(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGI(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGD(tag, fmt, ...) ((void)(tag))
+#endif
+
+static const char* TAG = "script";
+
+// Report a diagnostic for the current line
+static void report(script_parser_t* parser, script_diag_level_t level, const char* fmt, ...) {
+    char message[128];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    if (level == SCRIPT_DIAG_ERROR) {
+        parser->errors++;
+    } else {
+        parser->warnings++;
+    }
+
+    if (parser->diag) {
+        parser->diag(parser->diag_ctx, level, parser->line_number, message);
+    } else if (level == SCRIPT_DIAG_ERROR) {
+        ESP_LOGE(TAG, "Line %zu: %s", parser->line_number, message);
+    } else {
+        ESP_LOGW(TAG, "Line %zu: %s", parser->line_number, message);
+    }
+}
+
+// A token is a view into the line being parsed, never a copy
+typedef struct {
+    const char* str;
+    size_t len;
+} token_t;
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+static bool is_separator(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Helper function to get next token, returns position after the token
+static const char* next_token(const char* str, const char* end, token_t* token) {
+    while (str < end && (*str == ' ' || *str == '\t')) str++;
+    token->str = str;
+    while (str < end && !is_separator(*str)) str++;
+    token->len = str - token->str;
+    return str;
+}
+
+static bool token_equals(const token_t& token, const char* literal) {
+    size_t len = strlen(literal);
+    return token.len == len && memcmp(token.str, literal, len) == 0;
+}
+
+// atoi() equivalent for a token that is not NUL-terminated
+static int32_t token_to_int(const token_t& token) {
+    const char* str = token.str;
+    const char* end = token.str + token.len;
+    bool negative = false;
+    if (str < end && (*str == '-' || *str == '+')) {
+        negative = (*str == '-');
+        str++;
+    }
+    int32_t value = 0;
+    while (str < end && *str >= '0' && *str <= '9') {
+        value = value * 10 + (*str - '0');
+        str++;
+    }
+    return negative ? -value : value;
+}
+
+// Optionally signed decimal integer
+static bool token_is_int(const token_t& token) {
+    size_t i = (token.len > 0 && (token.str[0] == '-' || token.str[0] == '+')) ? 1 : 0;
+    if (i == token.len) {
+        return false;
+    }
+    for (; i < token.len; i++) {
+        if (token.str[i] < '0' || token.str[i] > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool token_is_number(const token_t& token) {
+    if (token.len == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < token.len; i++) {
+        if (token.str[i] < '0' || token.str[i] > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int find_alias(const script_parser_t* parser, const token_t& token) {
+    for (size_t i = 0; i < parser->alias_count; i++) {
+        const char* name = parser->aliases[i].name;
+        if (strncmp(name, token.str, token.len) == 0 && name[token.len] == '\0') {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// First alias declared for a pin, so ops using raw pin numbers are still labelled
+static int find_alias_for_pin(const script_parser_t* parser, alias_pin_kind_t kind, int pin) {
+    for (size_t i = 0; i < parser->alias_count; i++) {
+        if (parser->aliases[i].kind == kind && parser->aliases[i].pin == pin) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Resolve a raw pin name of the given kind
+static bool lookup_pin(alias_pin_kind_t kind, const token_t& token, int* pin) {
+    switch (kind) {
+        case ALIAS_PIN_SOURCE: {
+            source_net_t source;
+            if (!script_lookup_source(token.str, token.len, &source)) return false;
+            *pin = source;
+            return true;
+        }
+        case ALIAS_PIN_SINK: {
+            ADC_sink_t sink;
+            if (!script_lookup_sink(token.str, token.len, &sink)) return false;
+            *pin = sink;
+            return true;
+        }
+        case ALIAS_PIN_IO:
+            if (!token_is_number(token)) return false;
+            *pin = token_to_int(token);
+            return true;
+    }
+    return false;
+}
+
+// Resolve a pin argument: raw pin names first, then aliases of the same kind.
+// Unknown names fall back to default_pin as they always have.
+static int token_to_pin(script_parser_t* parser, const token_t& token, alias_pin_kind_t kind, int default_pin, int16_t* alias) {
+    int pin;
+    if (lookup_pin(kind, token, &pin)) {
+        *alias = find_alias_for_pin(parser, kind, pin);
+        return pin;
+    }
+
+    int index = find_alias(parser, token);
+    if (index >= 0 && parser->aliases[index].kind == kind) {
+        *alias = index;
+        return parser->aliases[index].pin;
+    }
+
+    if (index >= 0) {
+        report(parser, SCRIPT_DIAG_ERROR, "alias %.*s names a different kind of pin", (int)token.len, token.str);
+    } else {
+        report(parser, SCRIPT_DIAG_ERROR, "unknown pin %.*s", (int)token.len, token.str);
+    }
+    *alias = -1;
+    return default_pin;
+}
+
+static io_state_t token_to_io_state(script_parser_t* parser, const token_t& token) {
+    io_state_t state = IO_INPUT;
+    if (!script_lookup_io_state(token.str, token.len, &state)) {
+        report(parser, SCRIPT_DIAG_ERROR, "unknown IO state %.*s, expected h, l or z", (int)token.len, token.str);
+    }
+    return state;
+}
+
+static signal_shape_t token_to_signal_shape(script_parser_t* parser, const token_t& token) {
+    signal_shape_t shape = SIGNAL_SINE;
+    if (!script_lookup_signal_shape(token.str, token.len, &shape)) {
+        report(parser, SCRIPT_DIAG_ERROR, "unknown signal shape %.*s, expected sine, sq, tri, saw or pulse", (int)token.len, token.str);
+    }
+    return shape;
+}
+
+static current_rail_t token_to_current_rail(script_parser_t* parser, const token_t& token) {
+    current_rail_t rail = CURRENT_RAIL_12V;
+    if (!script_lookup_rail(token.str, token.len, &rail)) {
+        report(parser, SCRIPT_DIAG_ERROR, "unknown rail %.*s, expected +12, +5 or -12", (int)token.len, token.str);
+    }
+    return rail;
+}
+
+// Two-valued flag argument such as h/l or p/z
+static int32_t token_to_flag(script_parser_t* parser, const token_t& token, const char* set, const char* clear) {
+    if (token_equals(token, set)) {
+        return 1;
+    }
+    if (!token_equals(token, clear)) {
+        report(parser, SCRIPT_DIAG_ERROR, "unexpected %.*s, expected %s or %s", (int)token.len, token.str, set, clear);
+    }
+    return 0;
+}
+
+static int32_t token_to_value(script_parser_t* parser, const token_t& token) {
+    if (!token_is_int(token)) {
+        report(parser, SCRIPT_DIAG_ERROR, "expected a number, got '%.*s'", (int)token.len, token.str);
+    }
+    return token_to_int(token);
+}
+
+// Non-negative decimal with up to three fraction digits, such as "440.25", in thousandths
+static int32_t token_to_millis(script_parser_t* parser, const token_t& token) {
+    size_t i = 0;
+    size_t digits = 0;
+    int64_t value = 0;
+    int32_t scale = 1000;
+    while (i < token.len && token.str[i] >= '0' && token.str[i] <= '9' && value <= INT32_MAX) {
+        value = value * 10 + (token.str[i++] - '0');
+        digits++;
+    }
+    if (i < token.len && token.str[i] == '.') {
+        i++;
+        while (i < token.len && token.str[i] >= '0' && token.str[i] <= '9' && scale > 1) {
+            value = value * 10 + (token.str[i++] - '0');
+            scale /= 10;
+            digits++;
+        }
+    }
+    if (digits == 0 || i != token.len || value * scale > INT32_MAX) {
+        report(parser, SCRIPT_DIAG_ERROR, "expected a number with up to 3 decimals, got '%.*s'", (int)token.len, token.str);
+        return 0;
+    }
+    return (int32_t)(value * scale);
+}
+
+// Fetch the next argument of an operation, reporting it if missing
+static const char* next_arg(script_parser_t* parser, const char* str, const char* end, token_t* token, const char* what) {
+    str = next_token(str, end, token);
+    if (token->len == 0) {
+        report(parser, SCRIPT_DIAG_ERROR, "missing %s", what);
+    }
+    return str;
+}
+
+// Split a quantity such as "30s" into its leading number and unit
+static bool split_quantity(const token_t& token, int32_t* value, token_t* unit) {
+    size_t digits = 0;
+    while (digits < token.len && token.str[digits] >= '0' && token.str[digits] <= '9') digits++;
+
+    token_t number = {token.str, digits};
+    *unit = {token.str + digits, token.len - digits};
+    *value = token_to_int(number);
+    return digits > 0 && *value > 0;
+}
+
+// Milliseconds per duration unit "ms", "s" or "m", 0 for anything else
+static int32_t duration_scale(const token_t& unit) {
+    if (token_equals(unit, "ms")) return 1;
+    if (token_equals(unit, "s")) return 1000;
+    if (token_equals(unit, "m")) return 60000;
+    return 0;
+}
+
+// Parse a positive duration such as "500ms", "30s" or "5m", a bare number is in milliseconds
+static bool token_to_duration(script_parser_t* parser, const token_t& token, const char* what, uint32_t* ms) {
+    int32_t value;
+    token_t unit;
+    if (!split_quantity(token, &value, &unit)) {
+        report(parser, SCRIPT_DIAG_ERROR, "%s must be a positive duration, got '%.*s'", what, (int)token.len, token.str);
+        return false;
+    }
+    int32_t scale = unit.len == 0 ? 1 : duration_scale(unit);
+    if (scale == 0) {
+        report(parser, SCRIPT_DIAG_ERROR, "unknown %s unit '%.*s', expected ms, s or m", what, (int)unit.len, unit.str);
+        return false;
+    }
+    *ms = (uint32_t)value * scale;
+    return true;
+}
+
+// Parse a loop limit: "100" iterations or a duration such as "500ms", "30s", "5m"
+static void parse_loop_limit(script_parser_t* parser, const token_t& token, test_operation_t* op) {
+    int32_t value;
+    token_t unit;
+    if (!split_quantity(token, &value, &unit)) {
+        report(parser, SCRIPT_DIAG_ERROR, "loop limit must be a positive count or duration, got '%.*s'", (int)token.len, token.str);
+        return;
+    }
+
+    if (unit.len == 0) {
+        op->arg1 = value;
+        return;
+    }
+    int32_t scale = duration_scale(unit);
+    if (scale == 0) {
+        report(parser, SCRIPT_DIAG_ERROR, "unknown loop duration unit '%.*s', expected ms, s or m", (int)unit.len, unit.str);
+        return;
+    }
+    op->arg2 = value * scale;
+}
+
+// Parse one "<sink>:<low>:<high>" check of a sink list into op
+static void parse_sink_check(script_parser_t* parser, const token_t& token, test_operation_t* op) {
+    token_t fields[3];
+    size_t count = 0;
+    const char* str = token.str;
+    const char* end = token.str + token.len;
+    while (count < 3) {
+        const char* colon = (const char*)memchr(str, ':', end - str);
+        const char* field_end = (colon && count < 2) ? colon : end;
+        fields[count++] = {str, (size_t)(field_end - str)};
+        if (field_end == end) {
+            break;
+        }
+        str = field_end + 1;
+    }
+    if (count != 3 || fields[0].len == 0) {
+        report(parser, SCRIPT_DIAG_ERROR, "expected <sink>:<low>:<high>, got '%.*s'", (int)token.len, token.str);
+        return;
+    }
+    op->pin = token_to_pin(parser, fields[0], ALIAS_PIN_SINK, ADC_sink_1k_A, &op->alias);
+    op->arg1 = token_to_value(parser, fields[1]);
+    op->arg2 = token_to_value(parser, fields[2]);
+}
+
+// Parse an IO pin range "<first>-<last>" and a pattern with one state per pin,
+// first pin first. set/clear/input are the state characters, 'x' skips a pin.
+static void parse_io_pattern(script_parser_t* parser, const token_t& range, const token_t& pattern,
+                             const char* set, const char* clear, const char* input, test_operation_t* op) {
+    const char* dash = (const char*)memchr(range.str, '-', range.len);
+    token_t from = {range.str, dash ? (size_t)(dash - range.str) : range.len};
+    token_t to = dash ? token_t{dash + 1, (size_t)(range.str + range.len - dash - 1)} : from;
+    if (!token_is_number(from) || !token_is_number(to)) {
+        report(parser, SCRIPT_DIAG_ERROR, "expected an IO pin range such as 0-7, got '%.*s'", (int)range.len, range.str);
+        return;
+    }
+    int first = token_to_int(from);
+    int last = token_to_int(to);
+    if (first > last || last > IO15) {
+        report(parser, SCRIPT_DIAG_ERROR, "IO pin range %d-%d must be ascending within 0..15", first, last);
+        return;
+    }
+    if (pattern.len != (size_t)(last - first + 1)) {
+        report(parser, SCRIPT_DIAG_ERROR, "'%.*s' has %zu states for %d IO pins",
+               (int)pattern.len, pattern.str, pattern.len, last - first + 1);
+        return;
+    }
+
+    uint32_t levels = 0, mask = 0, inputs = 0;
+    for (size_t i = 0; i < pattern.len; i++) {
+        char c = pattern.str[i];
+        uint32_t bit = 1u << (first + i);
+        if (c == 'x') {
+            continue;
+        } else if (c != '\0' && strchr(set, c)) {
+            levels |= bit;
+        } else if (c != '\0' && input && strchr(input, c)) {
+            inputs |= bit;
+        } else if (c == '\0' || !strchr(clear, c)) {
+            report(parser, SCRIPT_DIAG_ERROR, "unexpected state '%c' for IO %d", c, first + (int)i);
+            return;
+        }
+        mask |= bit;
+    }
+    op->pin = first;
+    op->arg1 = (int32_t)levels;
+    op->arg2 = (int32_t)(mask | (inputs << 16));
+}
+
+// Parse a trailing "+" or "+2s" repeat marker, returns false if the token is something else
+static bool parse_repeat_marker(const token_t& token, uint32_t* timeout_ms) {
+    *timeout_ms = 0;
+    if (token.len == 0 || token.str[0] != '+') {
+        return false;
+    }
+    if (token.len == 1) {
+        return true;
+    }
+
+    // A deadline needs a unit, so "+12" stays a rail name or a signed value
+    int32_t value;
+    token_t unit;
+    token_t quantity = {token.str + 1, token.len - 1};
+    if (!split_quantity(quantity, &value, &unit) || unit.len == 0 || duration_scale(unit) == 0) {
+        return false;
+    }
+    *timeout_ms = (uint32_t)value * duration_scale(unit);
+    return true;
+}
+
+// Reject arguments the hardware cannot produce or a check can never satisfy
+static void validate_operation(script_parser_t* parser, const test_operation_t* op) {
+    script_args_t args = script_op_args(op->op);
+    if ((args == SCRIPT_ARGS_RAIL_RANGE || args == SCRIPT_ARGS_SINK_RANGE || args == SCRIPT_ARGS_SINK_LIST) &&
+        op->op != TEST_OP_SCOPE && op->arg1 > op->arg2) {
+        report(parser, SCRIPT_DIAG_ERROR, "impossible range %ld..%ld", (long)op->arg1, (long)op->arg2);
+    }
+    if (op->overlap && !script_op_is_check(op->op)) {
+        report(parser, SCRIPT_DIAG_ERROR, "'&' only applies to checks, %s always waits for a pending delay",
+               script_op_keyword(op->op));
+    }
+
+    switch (op->op) {
+        case TEST_OP_LOOP_START:
+        case TEST_OP_LOOP_END:
+            if (op->repeat) {
+                report(parser, SCRIPT_DIAG_WARNING, "'+' has no effect on loop markers");
+            }
+            break;
+        case TEST_OP_SOURCE:
+            if (op->arg1 < SCRIPT_SOURCE_MV_MIN || op->arg1 > SCRIPT_SOURCE_MV_MAX) {
+                report(parser, SCRIPT_DIAG_ERROR, "source voltage %ld mV outside %d..%d mV",
+                       (long)op->arg1, SCRIPT_SOURCE_MV_MIN, SCRIPT_SOURCE_MV_MAX);
+            }
+            break;
+        case TEST_OP_SOURCE_SIG:
+            if (op->arg1 < 0 || op->arg1 > SCRIPT_SIGNAL_FREQ_MAX * 1000) {
+                report(parser, SCRIPT_DIAG_ERROR, "signal frequency %ld.%03ld Hz outside 0..%d Hz",
+                       (long)(op->arg1 / 1000), (long)(op->arg1 % 1000), SCRIPT_SIGNAL_FREQ_MAX);
+            }
+            if (labs(op->arg3) + (long)SIGNAL_ARG2_AMPLITUDE(op->arg2) > SCRIPT_SOURCE_MV_MAX) {
+                report(parser, SCRIPT_DIAG_WARNING, "signal %ld mV +/- %ld mV clips at +/-%d mV",
+                       (long)op->arg3, (long)SIGNAL_ARG2_AMPLITUDE(op->arg2), SCRIPT_SOURCE_MV_MAX);
+            }
+            break;
+        case TEST_OP_SOURCE_WAVE:
+            if (op->arg2 < 1 || op->arg2 > SCRIPT_WAVE_RATE_MAX) {
+                report(parser, SCRIPT_DIAG_ERROR, "wave sample rate %ld Hz outside 1..%d Hz", (long)op->arg2, SCRIPT_WAVE_RATE_MAX);
+            }
+            break;
+        case TEST_OP_IO:
+        case TEST_OP_CHECK_IO_LEVEL:
+            if (op->pin < IO0 || op->pin > IO15) {
+                report(parser, SCRIPT_DIAG_ERROR, "IO pin %d outside 0..15", op->pin);
+            }
+            break;
+        case TEST_OP_CHECK_CURRENT:
+        case TEST_OP_CHECK_FREQ:
+        case TEST_OP_CHECK_AMPLITUDE:
+        case TEST_OP_CHECK_CUTOFF:
+            // Measured currents are clamped at 0, frequencies and amplitudes are never negative
+            if (op->arg2 < 0) {
+                report(parser, SCRIPT_DIAG_ERROR, "range %ld..%ld can never be met by a non-negative value", (long)op->arg1, (long)op->arg2);
+            }
+            break;
+        case TEST_OP_SCOPE:
+            if (op->arg1 <= 0 || op->arg2 <= 0) {
+                report(parser, SCRIPT_DIAG_ERROR, "scope needs a positive sample rate and buffer size");
+            }
+            parser->scope_pin = op->pin;
+            break;
+        case TEST_OP_SWEEP: {
+            const int32_t freqs[] = {op->arg2, op->arg3};
+            for (int32_t freq : freqs) {
+                if (freq < SCRIPT_SWEEP_FREQ_MIN * 1000 || freq > SCRIPT_SIGNAL_FREQ_MAX * 1000) {
+                    report(parser, SCRIPT_DIAG_ERROR, "sweep frequency %ld.%03ld Hz outside %d..%d Hz",
+                           (long)(freq / 1000), (long)(freq % 1000), SCRIPT_SWEEP_FREQ_MIN, SCRIPT_SIGNAL_FREQ_MAX);
+                }
+            }
+            if (op->arg2 == op->arg3) {
+                report(parser, SCRIPT_DIAG_ERROR, "sweep starts and stops at the same frequency");
+            }
+            // The sweep captures with Sigscoper too, its checks read the stored points
+            parser->sweep_pin = SWEEP_ARG1_SINK(op->arg1);
+            parser->scope_pin = -1;
+            break;
+        }
+        case TEST_OP_SETTLE:
+        case TEST_OP_SETTLE_CURRENT:
+            if (op->arg1 <= 0) {
+                report(parser, SCRIPT_DIAG_ERROR, "settle tolerance must be positive, got %ld", (long)op->arg1);
+            }
+            break;
+        case TEST_OP_CALIBRATE_SOURCE:
+            if (op->arg2 <= 0) {
+                report(parser, SCRIPT_DIAG_ERROR, "calibration error limit must be positive, got %ld", (long)op->arg2);
+            }
+            break;
+        case TEST_OP_DELAY:
+            if (op->arg1 < 0) {
+                report(parser, SCRIPT_DIAG_ERROR, "negative delay %ld ms", (long)op->arg1);
+            }
+            break;
+        default:
+            break;
+    }
+
+    // Signal checks read the capture started by the last scope op, sweep checks the points of the last sweep
+    bool reads_sweep = op->op == TEST_OP_CHECK_CUTOFF || op->op == TEST_OP_CHECK_SLOPE || op->op == TEST_OP_CHECK_PEAK;
+    if (reads_sweep && op->pin != parser->sweep_pin) {
+        report(parser, SCRIPT_DIAG_ERROR, "%s on %s without a preceding sweep on that pin",
+               script_op_keyword(op->op), script_sink_name((ADC_sink_t)op->pin));
+    } else if (op->op == TEST_OP_CHECK_FREQ) {
+        // Without a scope on the pin, freq captures on its own and later checks may read that
+        parser->scope_pin = op->pin;
+    } else if (args == SCRIPT_ARGS_SINK_RANGE && !reads_sweep && op->op != TEST_OP_SCOPE && op->op != TEST_OP_CHECK_PIN &&
+               op->pin != parser->scope_pin) {
+        report(parser, SCRIPT_DIAG_ERROR, "%s on %s without a preceding scope on that pin",
+               script_op_keyword(op->op), script_sink_name((ADC_sink_t)op->pin));
+    }
+}
+
+// Parse "# alias <name>=<out X|in X|io pin>" into the alias table
+static void parse_alias(script_parser_t* parser, const char* str, const char* end) {
+    const char* equals = (const char*)memchr(str, '=', end - str);
+    if (!equals) {
+        report(parser, SCRIPT_DIAG_ERROR, "alias without '='");
+        return;
+    }
+
+    token_t name;
+    next_token(str, equals, &name);
+    if (name.len == 0 || name.len >= TEST_ALIAS_NAME_MAX) {
+        report(parser, SCRIPT_DIAG_ERROR, "alias name must be 1-%d characters", TEST_ALIAS_NAME_MAX - 1);
+        return;
+    }
+    if (find_alias(parser, name) >= 0) {
+        report(parser, SCRIPT_DIAG_WARNING, "alias %.*s redefined, keeping the first definition", (int)name.len, name.str);
+        return;
+    }
+
+    token_t token;
+    str = next_token(equals + 1, end, &token);
+    alias_pin_kind_t kind = ALIAS_PIN_IO;
+    if (token_equals(token, "out")) {
+        kind = ALIAS_PIN_SOURCE;
+        str = next_token(str, end, &token);
+    } else if (token_equals(token, "in")) {
+        kind = ALIAS_PIN_SINK;
+        str = next_token(str, end, &token);
+    }
+
+    int pin;
+    if (!lookup_pin(kind, token, &pin) || (kind == ALIAS_PIN_IO && pin > IO15)) {
+        report(parser, SCRIPT_DIAG_ERROR, "alias %.*s has an invalid pin", (int)name.len, name.str);
+        return;
+    }
+
+    if (parser->alias_count == parser->alias_capacity) {
+        size_t new_capacity = parser->alias_capacity ? parser->alias_capacity * 2 : SCRIPT_ALIASES_INITIAL_CAPACITY;
+        test_alias_t* aliases = (test_alias_t*)realloc(parser->aliases, new_capacity * sizeof(test_alias_t));
+        if (!aliases) {
+            ESP_LOGE(TAG, "Failed to grow alias table to %zu entries", new_capacity);
+            parser->out_of_memory = true;
+            return;
+        }
+        parser->allocations++;
+        parser->aliases = aliases;
+        parser->alias_capacity = new_capacity;
+    }
+
+    test_alias_t* alias = &parser->aliases[parser->alias_count++];
+    memcpy(alias->name, name.str, name.len);
+    alias->name[name.len] = '\0';
+    alias->kind = kind;
+    alias->pin = pin;
+}
+
+// Start a test group at the next operation, "# # name" headers inside loops stay comments
+static void parse_group(script_parser_t* parser, const char* str, const char* end) {
+    if (parser->loop_depth > 0) {
+        return;
+    }
+    while (str < end && is_space(*str)) str++;
+
+    if (parser->group_count == parser->group_capacity) {
+        size_t new_capacity = parser->group_capacity ? parser->group_capacity * 2 : SCRIPT_GROUPS_INITIAL_CAPACITY;
+        test_group_t* groups = (test_group_t*)realloc(parser->groups, new_capacity * sizeof(test_group_t));
+        if (!groups) {
+            ESP_LOGE(TAG, "Failed to grow group table to %zu entries", new_capacity);
+            parser->out_of_memory = true;
+            return;
+        }
+        parser->allocations++;
+        parser->groups = groups;
+        parser->group_capacity = new_capacity;
+    }
+
+    // Long headers are truncated, the name is only shown to the operator
+    size_t len = end - str;
+    if (len >= TEST_GROUP_NAME_MAX) {
+        len = TEST_GROUP_NAME_MAX - 1;
+    }
+    test_group_t* group = &parser->groups[parser->group_count++];
+    memcpy(group->name, str, len);
+    group->name[len] = '\0';
+    group->first_op = parser->count;
+    group->end_op = parser->count;
+}
+
+// Parse "# <keyword> ..." lines that configure the script, other comments are ignored.
+// Limits only count as directives when a number follows, so prose comments stay comments.
+static void parse_directive(script_parser_t* parser, const char* str, const char* end) {
+    token_t keyword;
+    const char* rest = next_token(str, end, &keyword);
+    if (token_equals(keyword, "alias")) {
+        parse_alias(parser, rest, end);
+        return;
+    }
+    if (token_equals(keyword, "#")) {
+        parse_group(parser, rest, end);
+        return;
+    }
+
+    token_t value;
+    if (token_equals(keyword, "retest")) {
+        next_token(rest, end, &value);
+        if (token_equals(value, "groups")) {
+            parser->retest_groups = true;
+        }
+        return;
+    }
+
+    rest = next_token(rest, end, &value);
+    if (value.len == 0 || value.str[0] < '0' || value.str[0] > '9') {
+        return;
+    }
+
+    test_limits_t* limits = &parser->limits;
+    if (token_equals(keyword, "deadline")) {
+        token_to_duration(parser, value, "deadline", &limits->deadline_ms);
+    } else if (token_equals(keyword, "timeout")) {
+        token_to_duration(parser, value, "timeout", &limits->retry_timeout_ms);
+    } else if (token_equals(keyword, "backoff")) {
+        // "# backoff <first> [max]", the retry delay doubles up to max
+        if (token_to_duration(parser, value, "backoff", &limits->backoff_ms)) {
+            limits->backoff_max_ms = limits->backoff_ms;
+            next_token(rest, end, &value);
+            if (value.len > 0 && token_to_duration(parser, value, "backoff limit", &limits->backoff_max_ms) &&
+                limits->backoff_max_ms < limits->backoff_ms) {
+                report(parser, SCRIPT_DIAG_ERROR, "backoff limit is below the first retry delay");
+                limits->backoff_max_ms = limits->backoff_ms;
+            }
+        }
+    }
+}
+
+// Make room for one more operation, doubling the capacity when full
+static test_operation_t* push_operation(script_parser_t* parser) {
+    if (parser->count == parser->capacity) {
+        size_t new_capacity = parser->capacity ? parser->capacity * 2 : SCRIPT_OPS_INITIAL_CAPACITY;
+        test_operation_t* ops = (test_operation_t*)realloc(parser->ops, new_capacity * sizeof(test_operation_t));
+        if (!ops) {
+            ESP_LOGE(TAG, "Failed to grow operations array to %zu entries", new_capacity);
+            parser->out_of_memory = true;
+            return nullptr;
+        }
+        parser->allocations++;
+        parser->ops = ops;
+        parser->capacity = new_capacity;
+    }
+    return &parser->ops[parser->count];
+}
+
+// Parse a single line, tokenizing it in place
+static void parse_line(script_parser_t* parser, const char* line, size_t len, bool truncated) {
+    parser->line_number++;
+
+    // Trim the line
+    const char* end = line + len;
+    while (line < end && is_space(*line)) line++;
+    while (end > line && is_space(end[-1])) end--;
+
+    if (line == end) {
+        return;
+    }
+
+    if (*line == '#') {
+        if (!truncated) {
+            parse_directive(parser, line + 1, end);
+        }
+        return;
+    }
+
+    if (truncated) {
+        report(parser, SCRIPT_DIAG_ERROR, "line is longer than %d characters, skipped", SCRIPT_LINE_MAX);
+        return;
+    }
+
+    // Check for the overlap flag: "&" at end of line, after any repeat marker
+    bool overlap_flag = false;
+    if (end[-1] == '&') {
+        overlap_flag = true;
+        end--;
+        while (end > line && is_space(end[-1])) end--;
+        if (end == line) {
+            report(parser, SCRIPT_DIAG_ERROR, "'&' without an operation");
+            return;
+        }
+    }
+
+    // Check for repeat flag: "+" at end of line, or a last token "+<duration>" with a retry deadline
+    bool repeat_flag = false;
+    uint32_t timeout_ms = 0;
+    if (end[-1] == '+') {
+        repeat_flag = true;
+        end--;
+    } else {
+        const char* last = end;
+        while (last > line && !is_space(last[-1])) last--;
+        token_t marker = {last, (size_t)(end - last)};
+        if (last > line && parse_repeat_marker(marker, &timeout_ms)) {
+            repeat_flag = true;
+            end = last;
+        }
+    }
+
+    token_t token;
+    const char* str = next_token(line, end, &token);
+
+    if (token_equals(token, "module")) {
+        // Legacy "module <name> <id>" header, the name and ID now come from the file name
+        return;
+    }
+
+    test_op_type_t type;
+    if (!script_lookup_op(token.str, token.len, &type)) {
+        report(parser, SCRIPT_DIAG_ERROR, "unknown operation %.*s", (int)token.len, token.str);
+        return;
+    }
+
+    if (type == TEST_OP_LOOP_START && parser->loop_depth == SCRIPT_LOOP_DEPTH_MAX) {
+        report(parser, SCRIPT_DIAG_ERROR, "loops nested deeper than %d levels", SCRIPT_LOOP_DEPTH_MAX);
+        return;
+    }
+    if (type == TEST_OP_LOOP_END && parser->loop_depth == 0) {
+        report(parser, SCRIPT_DIAG_ERROR, "'}' without matching '{'");
+        return;
+    }
+    if (parser->unreachable && type != TEST_OP_LOOP_END) {
+        report(parser, SCRIPT_DIAG_WARNING, "operations after an infinite loop never run");
+        parser->unreachable = false;
+    }
+
+    test_operation_t* op = push_operation(parser);
+    if (!op) {
+        return;
+    }
+
+    op->repeat = repeat_flag;
+    op->overlap = overlap_flag;
+    op->timeout_ms = timeout_ms;
+    op->alias = -1;
+    op->op = type;
+    op->pin = 0;
+    op->arg1 = 0;
+    op->arg2 = 0;
+    op->arg3 = 0;
+
+    script_args_t args = script_op_args(type);
+    switch (args) {
+        case SCRIPT_ARGS_NONE:
+            break;
+
+        case SCRIPT_ARGS_VALUE:
+            str = next_arg(parser, str, end, &token, "value");
+            op->arg1 = token_to_value(parser, token); // Timeout in milliseconds
+            break;
+
+        case SCRIPT_ARGS_SOURCE_VALUE:
+            str = next_arg(parser, str, end, &token, "source");
+            op->pin = token_to_pin(parser, token, ALIAS_PIN_SOURCE, SOURCE_A, &op->alias);
+            str = next_arg(parser, str, end, &token, "value");
+            op->arg1 = token_to_value(parser, token); // Voltage in mV
+            break;
+
+        case SCRIPT_ARGS_SOURCE_SIGNAL: {
+            str = next_arg(parser, str, end, &token, "source");
+            op->pin = token_to_pin(parser, token, ALIAS_PIN_SOURCE, SOURCE_A, &op->alias);
+            str = next_arg(parser, str, end, &token, "frequency");
+            op->arg1 = token_to_millis(parser, token);
+            // Optional waveform, each argument needs the ones before it
+            signal_shape_t shape = SIGNAL_SINE;
+            int32_t amplitude = SCRIPT_SIGNAL_AMPLITUDE_DEFAULT;
+            int32_t duty = SCRIPT_SIGNAL_DUTY_DEFAULT;
+            str = next_token(str, end, &token);
+            if (token.len > 0) {
+                shape = token_to_signal_shape(parser, token);
+                str = next_token(str, end, &token);
+            }
+            if (token.len > 0) {
+                amplitude = token_to_value(parser, token);
+                str = next_token(str, end, &token);
+            }
+            if (token.len > 0) {
+                op->arg3 = token_to_value(parser, token);
+                str = next_token(str, end, &token);
+            }
+            if (token.len > 0) {
+                duty = token_to_value(parser, token);
+            }
+            // Checked here, out-of-range values do not survive the packing into arg2
+            if (amplitude < 0 || amplitude > SCRIPT_SOURCE_MV_MAX) {
+                report(parser, SCRIPT_DIAG_ERROR, "signal amplitude %ld mV outside 0..%d mV", (long)amplitude, SCRIPT_SOURCE_MV_MAX);
+                amplitude = 0;
+            }
+            if (op->arg3 < SCRIPT_SOURCE_MV_MIN || op->arg3 > SCRIPT_SOURCE_MV_MAX) {
+                report(parser, SCRIPT_DIAG_ERROR, "signal offset %ld mV outside %d..%d mV",
+                       (long)op->arg3, SCRIPT_SOURCE_MV_MIN, SCRIPT_SOURCE_MV_MAX);
+                op->arg3 = 0;
+            }
+            if (duty < 1 || duty > 99) {
+                report(parser, SCRIPT_DIAG_ERROR, "duty cycle %ld%% outside 1..99%%", (long)duty);
+                duty = SCRIPT_SIGNAL_DUTY_DEFAULT;
+            }
+            op->arg2 = SIGNAL_ARG2(shape, amplitude, duty);
+            break;
+        }
+
+        case SCRIPT_ARGS_SOURCE_WAVE:
+            str = next_arg(parser, str, end, &token, "source");
+            op->pin = token_to_pin(parser, token, ALIAS_PIN_SOURCE, SOURCE_A, &op->alias);
+            // The file is found by its name hash at run time, see wave_open()
+            str = next_arg(parser, str, end, &token, "file");
+            if (token.len > SCRIPT_WAVE_NAME_MAX) {
+                report(parser, SCRIPT_DIAG_ERROR, "wave file name %.*s longer than %d characters",
+                       (int)token.len, token.str, SCRIPT_WAVE_NAME_MAX);
+            }
+            op->arg1 = (int32_t)script_hash_update(SCRIPT_HASH_INIT, token.str, token.len);
+            str = next_arg(parser, str, end, &token, "sample rate");
+            op->arg2 = token_to_value(parser, token);
+            str = next_token(str, end, &token);
+            if (token.len > 0) {
+                op->arg3 = token_to_flag(parser, token, "loop", "once");
+            }
+            break;
+
+        case SCRIPT_ARGS_IO_STATE:
+            str = next_arg(parser, str, end, &token, "IO pin");
+            op->pin = token_to_pin(parser, token, ALIAS_PIN_IO, token_to_int(token), &op->alias);
+            str = next_arg(parser, str, end, &token, "IO state");
+            op->arg1 = token_to_io_state(parser, token);
+            break;
+
+        case SCRIPT_ARGS_IO_LEVEL:
+            str = next_arg(parser, str, end, &token, "IO pin");
+            op->pin = token_to_pin(parser, token, ALIAS_PIN_IO, token_to_int(token), &op->alias);
+            str = next_arg(parser, str, end, &token, "IO level");
+            // h = HIGH = 1, l = LOW = 0
+            op->arg1 = token_to_flag(parser, token, "h", "l");
+            break;
+
+        case SCRIPT_ARGS_IO_PORT:
+        case SCRIPT_ARGS_IO_LEVELS: {
+            token_t range;
+            str = next_arg(parser, str, end, &range, "IO pin range");
+            str = next_arg(parser, str, end, &token, args == SCRIPT_ARGS_IO_PORT ? "IO states" : "IO levels");
+            if (token.len > 0) {
+                if (args == SCRIPT_ARGS_IO_PORT) {
+                    parse_io_pattern(parser, range, token, "h", "l", "z", op);
+                } else {
+                    parse_io_pattern(parser, range, token, "1h", "0l", nullptr, op);
+                }
+            }
+            break;
+        }
+
+        case SCRIPT_ARGS_PD:
+            str = next_arg(parser, str, end, &token, "sink");
+            op->pin = 0; // Assuming PIN_SINK_PD_A
+            str = next_arg(parser, str, end, &token, "pulldown state");
+            op->arg1 = token_to_flag(parser, token, "p", "z");
+            break;
+
+        case SCRIPT_ARGS_RAIL_RANGE:
+            str = next_arg(parser, str, end, &token, "rail");
+            op->pin = token_to_current_rail(parser, token);
+            str = next_arg(parser, str, end, &token, "low value");
+            op->arg1 = token_to_value(parser, token);
+            str = next_arg(parser, str, end, &token, "high value");
+            op->arg2 = token_to_value(parser, token);
+            break;
+
+        case SCRIPT_ARGS_SINK_RANGE:
+            // For scope arg1 is the sample frequency and arg2 the buffer size
+            str = next_arg(parser, str, end, &token, "sink");
+            op->pin = token_to_pin(parser, token, ALIAS_PIN_SINK, ADC_sink_1k_A, &op->alias);
+            str = next_arg(parser, str, end, &token, "low value");
+            op->arg1 = token_to_value(parser, token); // Low value
+            str = next_arg(parser, str, end, &token, "high value");
+            op->arg2 = token_to_value(parser, token); // High value
+            break;
+
+        case SCRIPT_ARGS_SINK_LIST: {
+            // Every check becomes its own operation with its own result, the
+            // interpreter measures consecutive ones in a single sweep
+            str = next_arg(parser, str, end, &token, "sink check");
+            if (token.len == 0) {
+                break;
+            }
+            parse_sink_check(parser, token, op);
+            str = next_token(str, end, &token);
+            while (token.len > 0) {
+                validate_operation(parser, op);
+                parser->count++;
+                test_operation_t* next = push_operation(parser);
+                if (!next) {
+                    return;
+                }
+                // Same type, repeat and overlap flags as the first check
+                *next = parser->ops[parser->count - 1];
+                op = next;
+                op->alias = -1;
+                op->pin = 0;
+                op->arg1 = 0;
+                op->arg2 = 0;
+                op->arg3 = 0;
+                parse_sink_check(parser, token, op);
+                str = next_token(str, end, &token);
+            }
+            break;
+        }
+
+        case SCRIPT_ARGS_SINK_SETTLE:
+        case SCRIPT_ARGS_RAIL_SETTLE: {
+            str = next_arg(parser, str, end, &token, args == SCRIPT_ARGS_RAIL_SETTLE ? "rail" : "sink");
+            if (args == SCRIPT_ARGS_RAIL_SETTLE) {
+                op->pin = token_to_current_rail(parser, token);
+            } else {
+                op->pin = token_to_pin(parser, token, ALIAS_PIN_SINK, ADC_sink_1k_A, &op->alias);
+            }
+            str = next_arg(parser, str, end, &token, "tolerance");
+            op->arg1 = token_to_value(parser, token);
+            str = next_arg(parser, str, end, &token, "timeout");
+            uint32_t timeout_ms = 0;
+            if (token.len > 0 && token_to_duration(parser, token, "settle timeout", &timeout_ms)) {
+                op->arg2 = (int32_t)timeout_ms;
+            }
+            break;
+        }
+
+        case SCRIPT_ARGS_SOURCE_CAL: {
+            str = next_arg(parser, str, end, &token, "source");
+            op->pin = token_to_pin(parser, token, ALIAS_PIN_SOURCE, SOURCE_A, &op->alias);
+            // Only the source keeps its alias, the sink is named in the log by its pin
+            int16_t sink_alias;
+            str = next_arg(parser, str, end, &token, "sink");
+            op->arg1 = token_to_pin(parser, token, ALIAS_PIN_SINK, ADC_sink_1k_A, &sink_alias);
+            str = next_arg(parser, str, end, &token, "max error");
+            op->arg2 = token_to_value(parser, token);
+            break;
+        }
+
+        case SCRIPT_ARGS_SWEEP: {
+            str = next_arg(parser, str, end, &token, "source");
+            op->pin = token_to_pin(parser, token, ALIAS_PIN_SOURCE, SOURCE_A, &op->alias);
+            // As for calsrc, only the source keeps its alias
+            int16_t sink_alias;
+            str = next_arg(parser, str, end, &token, "sink");
+            int sink = token_to_pin(parser, token, ALIAS_PIN_SINK, ADC_sink_1k_A, &sink_alias);
+            str = next_arg(parser, str, end, &token, "start frequency");
+            op->arg2 = token_to_millis(parser, token);
+            str = next_arg(parser, str, end, &token, "stop frequency");
+            op->arg3 = token_to_millis(parser, token);
+            str = next_arg(parser, str, end, &token, "points");
+            int32_t points = token_to_value(parser, token);
+            // Checked here, out-of-range counts do not survive the packing into arg1
+            if (points < 2 || points > SWEEP_POINTS_MAX) {
+                report(parser, SCRIPT_DIAG_ERROR, "sweep needs 2..%d points, got %ld", SWEEP_POINTS_MAX, (long)points);
+                points = 2;
+            }
+            op->arg1 = SWEEP_ARG1(sink, points);
+            break;
+        }
+
+        case SCRIPT_ARGS_LOOP_START:
+            // Optional limit: iteration count or duration, forever without one
+            str = next_token(str, end, &token);
+            if (token.len > 0) {
+                parse_loop_limit(parser, token, op);
+            }
+            parser->loop_stack[parser->loop_depth++] = parser->count;
+            ESP_LOGD(TAG, "Loop start at operation %zu", parser->count);
+            break;
+
+        case SCRIPT_ARGS_LOOP_END: {
+            size_t start = parser->loop_stack[--parser->loop_depth];
+            op->pin = start;
+            parser->ops[start].pin = parser->count;
+            if (parser->ops[start].arg1 == 0 && parser->ops[start].arg2 == 0) {
+                parser->unreachable = true;
+            }
+            ESP_LOGD(TAG, "Loop end at operation %zu", parser->count);
+            break;
+        }
+    }
+
+    next_token(str, end, &token);
+    if (token.len > 0) {
+        report(parser, SCRIPT_DIAG_WARNING, "extra arguments ignored: %.*s", (int)(end - token.str), token.str);
+    }
+
+    validate_operation(parser, op);
+    parser->count++;
+}
+
+void script_parser_init(script_parser_t* parser) {
+    parser->ops = nullptr;
+    parser->count = 0;
+    parser->capacity = 0;
+    parser->aliases = nullptr;
+    parser->alias_count = 0;
+    parser->alias_capacity = 0;
+    parser->groups = nullptr;
+    parser->group_count = 0;
+    parser->group_capacity = 0;
+    parser->retest_groups = false;
+    parser->limits.deadline_ms = 0;
+    parser->limits.retry_timeout_ms = 0;
+    parser->limits.backoff_ms = SCRIPT_BACKOFF_DEFAULT_MS;
+    parser->limits.backoff_max_ms = SCRIPT_BACKOFF_DEFAULT_MS;
+    parser->loop_depth = 0;
+    parser->unreachable = false;
+    parser->line_number = 0;
+    parser->allocations = 0;
+    parser->out_of_memory = false;
+    parser->scope_pin = -1;
+    parser->sweep_pin = -1;
+    parser->errors = 0;
+    parser->warnings = 0;
+    parser->diag = nullptr;
+    parser->diag_ctx = nullptr;
+    parser->carry_len = 0;
+    parser->carry_overflow = false;
+}
+
+// Append part of a line to the carry buffer
+static void carry_append(script_parser_t* parser, const char* data, size_t len) {
+    size_t room = sizeof(parser->carry) - parser->carry_len;
+    if (len > room) {
+        len = room;
+        parser->carry_overflow = true;
+    }
+    memcpy(parser->carry + parser->carry_len, data, len);
+    parser->carry_len += len;
+}
+
+static void parse_carry(script_parser_t* parser) {
+    parse_line(parser, parser->carry, parser->carry_len, parser->carry_overflow);
+    parser->carry_len = 0;
+    parser->carry_overflow = false;
+}
+
+void script_parser_set_diag(script_parser_t* parser, script_diag_fn diag, void* ctx) {
+    parser->diag = diag;
+    parser->diag_ctx = ctx;
+}
+
+bool script_parser_feed(script_parser_t* parser, const char* data, size_t len) {
+    const char* end = data + len;
+
+    while (data < end) {
+        const char* newline = (const char*)memchr(data, '\n', end - data);
+        if (!newline) {
+            // Partial line, wait for the rest in the next chunk
+            carry_append(parser, data, end - data);
+            break;
+        }
+
+        size_t line_len = newline - data;
+        if (parser->carry_len > 0 || parser->carry_overflow) {
+            carry_append(parser, data, line_len);
+            parse_carry(parser);
+        } else {
+            parse_line(parser, data, line_len, line_len > SCRIPT_LINE_MAX);
+        }
+        data = newline + 1;
+    }
+
+    return !parser->out_of_memory;
+}
+
+bool script_parser_finish(script_parser_t* parser) {
+    // Last line has no trailing newline
+    if (parser->carry_len > 0 || parser->carry_overflow) {
+        parse_carry(parser);
+    }
+
+    // Close loops left open so the interpreter always sees matched markers
+    while (parser->loop_depth > 0 && !parser->out_of_memory) {
+        size_t start = parser->loop_stack[parser->loop_depth - 1];
+        report(parser, SCRIPT_DIAG_ERROR, "'{' at operation %zu is never closed", start);
+        test_operation_t* op = push_operation(parser);
+        if (!op) {
+            break;
+        }
+        op->repeat = false;
+        op->overlap = false;
+        op->timeout_ms = 0;
+        op->alias = -1;
+        op->op = TEST_OP_LOOP_END;
+        op->pin = start;
+        op->arg1 = 0;
+        op->arg2 = 0;
+        op->arg3 = 0;
+        parser->ops[start].pin = parser->count;
+        parser->count++;
+        parser->loop_depth--;
+    }
+
+    // Release the slack left by geometric growth
+    if (parser->ops && parser->count < parser->capacity) {
+        if (parser->count == 0) {
+            free(parser->ops);
+            parser->ops = nullptr;
+            parser->capacity = 0;
+        } else {
+            test_operation_t* ops = (test_operation_t*)realloc(parser->ops, parser->count * sizeof(test_operation_t));
+            if (ops) {
+                parser->allocations++;
+                parser->ops = ops;
+                parser->capacity = parser->count;
+            }
+        }
+    }
+
+    if (parser->aliases && parser->alias_count < parser->alias_capacity && parser->alias_count > 0) {
+        test_alias_t* aliases = (test_alias_t*)realloc(parser->aliases, parser->alias_count * sizeof(test_alias_t));
+        if (aliases) {
+            parser->allocations++;
+            parser->aliases = aliases;
+            parser->alias_capacity = parser->alias_count;
+        }
+    }
+
+    // A group runs up to the next header, the last one to the end of the script
+    for (size_t i = 0; i < parser->group_count; i++) {
+        parser->groups[i].end_op = (i + 1 < parser->group_count) ? parser->groups[i + 1].first_op : parser->count;
+    }
+
+    return !parser->out_of_memory;
+}
+
+void script_parser_take_program(script_parser_t* parser, script_program_t* program) {
+    program->ops = parser->ops;
+    program->count = parser->count;
+    program->aliases = parser->aliases;
+    program->alias_count = parser->alias_count;
+    program->groups = parser->groups;
+    program->group_count = parser->group_count;
+    program->retest_groups = parser->retest_groups;
+    program->limits = parser->limits;
+    parser->ops = nullptr;
+    parser->count = 0;
+    parser->capacity = 0;
+    parser->aliases = nullptr;
+    parser->alias_count = 0;
+    parser->alias_capacity = 0;
+    parser->groups = nullptr;
+    parser->group_count = 0;
+    parser->group_capacity = 0;
+}
+
+void script_parser_release(script_parser_t* parser) {
+    free(parser->ops);
+    free(parser->aliases);
+    free(parser->groups);
+    parser->ops = nullptr;
+    parser->count = 0;
+    parser->capacity = 0;
+    parser->aliases = nullptr;
+    parser->alias_count = 0;
+    parser->alias_capacity = 0;
+    parser->groups = nullptr;
+    parser->group_count = 0;
+    parser->group_capacity = 0;
+}
+
+uint32_t script_hash_update(uint32_t hash, const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= SCRIPT_HASH_PRIME;
+    }
+    return hash;
+}
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include "script_registry.h"
+#include <cstring>
+
+// Open-addressing hash table built at compile time from a registry X-macro
+struct keyword_entry {
+    const char* keyword;
+    int value;
+};
+
+template <size_t N>
+struct keyword_table {
+    static_assert((N & (N - 1)) == 0, "Table size must be a power of two");
+    keyword_entry slots[N];
+};
+
+static constexpr size_t keyword_length(const char* str) {
+    size_t len = 0;
+    while (str[len]) len++;
+    return len;
+}
+
+// FNV-1a, the same hash is used at compile time and at lookup time
+static constexpr uint32_t keyword_hash(const char* str, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template <size_t N, size_t M>
+static constexpr keyword_table<N> build_table(const keyword_entry (&entries)[M]) {
+    static_assert(M < N, "Table must keep at least one empty slot");
+    keyword_table<N> table{};
+    for (size_t i = 0; i < M; i++) {
+        size_t slot = keyword_hash(entries[i].keyword, keyword_length(entries[i].keyword)) & (N - 1);
+        while (table.slots[slot].keyword) {
+            slot = (slot + 1) & (N - 1);
+        }
+        table.slots[slot] = entries[i];
+    }
+    return table;
+}
+
+// Reverse table indexed by value, independent of the registry entry order
+template <size_t N>
+struct name_table {
+    const char* names[N];
+};
+
+template <size_t N, size_t M>
+static constexpr name_table<N> build_names(const keyword_entry (&entries)[M]) {
+    name_table<N> table{};
+    for (size_t i = 0; i < M; i++) {
+        table.names[entries[i].value] = entries[i].keyword;
+    }
+    return table;
+}
+
+template <size_t N>
+static bool table_lookup(const keyword_table<N>& table, const char* str, size_t len, int* value) {
+    size_t slot = keyword_hash(str, len) & (N - 1);
+    while (const char* keyword = table.slots[slot].keyword) {
+        if (strncmp(keyword, str, len) == 0 && keyword[len] == '\0') {
+            *value = table.slots[slot].value;
+            return true;
+        }
+        slot = (slot + 1) & (N - 1);
+    }
+    return false;
+}
+
+// Operations
+#define OP_ENTRY(op, keyword, name, args) {keyword, op},
+#define OP_KEYWORD(op, keyword, name, args) keyword,
+#define OP_NAME(op, keyword, name, args) name,
+#define OP_ARGS(op, keyword, name, args) args,
+
+static constexpr keyword_entry op_entries[] = { TEST_OPS(OP_ENTRY) };
+static constexpr keyword_table<32> op_table = build_table<32>(op_entries);
+static const char* const op_keywords[TEST_OP_COUNT] = { TEST_OPS(OP_KEYWORD) };
+static const char* const op_names[TEST_OP_COUNT] = { TEST_OPS(OP_NAME) };
+static const script_args_t op_args[TEST_OP_COUNT] = { TEST_OPS(OP_ARGS) };
+
+bool script_lookup_op(const char* str, size_t len, test_op_type_t* op) {
+    int value;
+    if (!table_lookup(op_table, str, len, &value)) {
+        return false;
+    }
+    *op = (test_op_type_t)value;
+    return true;
+}
+
+script_args_t script_op_args(test_op_type_t op) {
+    return (op < TEST_OP_COUNT) ? op_args[op] : SCRIPT_ARGS_NONE;
+}
+
+const char* script_op_keyword(test_op_type_t op) {
+    return (op < TEST_OP_COUNT) ? op_keywords[op] : "?";
+}
+
+const char* script_op_name(test_op_type_t op) {
+    return (op < TEST_OP_COUNT) ? op_names[op] : "UNKNOWN";
+}
+
+bool script_op_is_control(test_op_type_t op) {
+    script_args_t args = script_op_args(op);
+    return args == SCRIPT_ARGS_LOOP_START || args == SCRIPT_ARGS_LOOP_END;
+}
+
+bool script_op_is_check(test_op_type_t op) {
+    switch (op) {
+        case TEST_OP_CHECK_CURRENT:
+        case TEST_OP_CHECK_PIN:
+        case TEST_OP_CHECK_PIN_MULTI:
+        case TEST_OP_CHECK_IO_LEVEL:
+        case TEST_OP_CHECK_IO_LEVELS:
+        case TEST_OP_CHECK_MIN:
+        case TEST_OP_CHECK_MAX:
+        case TEST_OP_CHECK_AVG:
+        case TEST_OP_CHECK_FREQ:
+        case TEST_OP_CHECK_AMPLITUDE:
+        case TEST_OP_CHECK_CUTOFF:
+        case TEST_OP_CHECK_SLOPE:
+        case TEST_OP_CHECK_PEAK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool script_op_runs_in_delay(const test_operation_t& op) {
+    switch (op.op) {
+        case TEST_OP_CHECK_CUTOFF:
+        case TEST_OP_CHECK_SLOPE:
+        case TEST_OP_CHECK_PEAK:
+            return true;
+        default:
+            return op.overlap && script_op_is_check(op.op);
+    }
+}
+
+// Sinks
+#define SINK_ENTRY(sink, keyword) {keyword, sink},
+
+static constexpr keyword_entry sink_entries[] = { SCRIPT_SINKS(SINK_ENTRY) };
+static constexpr keyword_table<32> sink_table = build_table<32>(sink_entries);
+static constexpr name_table<ADC_sink_count> sink_names = build_names<ADC_sink_count>(sink_entries);
+
+bool script_lookup_sink(const char* str, size_t len, ADC_sink_t* sink) {
+    int value;
+    if (!table_lookup(sink_table, str, len, &value)) {
+        return false;
+    }
+    *sink = (ADC_sink_t)value;
+    return true;
+}
+
+const char* script_sink_name(ADC_sink_t sink) {
+    return (sink < ADC_sink_count) ? sink_names.names[sink] : "Unknown";
+}
+
+// Sources
+#define SOURCE_ENTRY(source, keyword) {keyword, source},
+
+static constexpr keyword_entry source_entries[] = { SCRIPT_SOURCES(SOURCE_ENTRY) };
+static constexpr keyword_table<8> source_table = build_table<8>(source_entries);
+static constexpr name_table<SOURCE_COUNT> source_names = build_names<SOURCE_COUNT>(source_entries);
+
+bool script_lookup_source(const char* str, size_t len, source_net_t* source) {
+    int value;
+    if (!table_lookup(source_table, str, len, &value)) {
+        return false;
+    }
+    *source = (source_net_t)value;
+    return true;
+}
+
+const char* script_source_name(source_net_t source) {
+    return (source < SOURCE_COUNT) ? source_names.names[source] : "Unknown";
+}
+
+// Current rails, the enum is generated from SCRIPT_RAILS so entries are in order
+#define RAIL_ENTRY(rail, keyword, name, pin) {keyword, rail},
+#define RAIL_NAME(rail, keyword, name, pin) name,
+#define RAIL_PIN(rail, keyword, name, pin) pin,
+
+static constexpr keyword_entry rail_entries[] = { SCRIPT_RAILS(RAIL_ENTRY) };
+static constexpr keyword_table<8> rail_table = build_table<8>(rail_entries);
+static const char* const rail_names[CURRENT_RAIL_COUNT] = { SCRIPT_RAILS(RAIL_NAME) };
+static const int rail_pins[CURRENT_RAIL_COUNT] = { SCRIPT_RAILS(RAIL_PIN) };
+
+bool script_lookup_rail(const char* str, size_t len, current_rail_t* rail) {
+    int value;
+    if (!table_lookup(rail_table, str, len, &value)) {
+        return false;
+    }
+    *rail = (current_rail_t)value;
+    return true;
+}
+
+const char* script_rail_name(current_rail_t rail) {
+    return (rail < CURRENT_RAIL_COUNT) ? rail_names[rail] : "Unknown";
+}
+
+int script_rail_pin(current_rail_t rail) {
+    return (rail < CURRENT_RAIL_COUNT) ? rail_pins[rail] : -1;
+}
+
+// IO states
+#define IO_STATE_ENTRY(state, keyword) {keyword, state},
+
+static constexpr keyword_entry io_state_entries[] = { SCRIPT_IO_STATES(IO_STATE_ENTRY) };
+static constexpr keyword_table<8> io_state_table = build_table<8>(io_state_entries);
+
+bool script_lookup_io_state(const char* str, size_t len, io_state_t* state) {
+    int value;
+    if (!table_lookup(io_state_table, str, len, &value)) {
+        return false;
+    }
+    *state = (io_state_t)value;
+    return true;
+}
+
+// Signal shapes
+#define SIGNAL_SHAPE_ENTRY(shape, keyword) {keyword, shape},
+
+static constexpr keyword_entry signal_shape_entries[] = { SCRIPT_SIGNAL_SHAPES(SIGNAL_SHAPE_ENTRY) };
+static constexpr keyword_table<8> signal_shape_table = build_table<8>(signal_shape_entries);
+static constexpr name_table<SIGNAL_SHAPE_COUNT> signal_shape_names = build_names<SIGNAL_SHAPE_COUNT>(signal_shape_entries);
+
+bool script_lookup_signal_shape(const char* str, size_t len, signal_shape_t* shape) {
+    int value;
+    if (!table_lookup(signal_shape_table, str, len, &value)) {
+        return false;
+    }
+    *shape = (signal_shape_t)value;
+    return true;
+}
+
+const char* script_signal_shape_name(signal_shape_t shape) {
+    return (shape < SIGNAL_SHAPE_COUNT) ? signal_shape_names.names[shape] : "Unknown";
+}
@@ -1,23 +1,74 @@
 #include "test_helpers.h"
+#include "script_registry.h"
 #include "board.h"
 #include "hal.h"
+#include "adc_dma.h"
 #include "display.h"
 #include "test_results.h"
+#include "modules.h"
+#include "freq_sweep.h"
+#include "goertzel.h"
 #include <LittleFS.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
 
 static const char* TAG = "test_helpers";
 
 // Global Sigscoper instance and state
 Sigscoper global_sigscoper;
 int last_scope_pin = -1;
+
+// Extra time allowed over the nominal capture length before a signal check gives up
+#define SCOPE_WAIT_MARGIN_MS 500
+
+// Sweep checks: the cutoff is this far below the gain of the first point, the
+// slope is fitted to the points at least SWEEP_SLOPE_DEPTH_DB below it
+#define SWEEP_CUTOFF_DB 3.0
+#define SWEEP_SLOPE_DEPTH_DB 10.0
+
+// Sample rate measurement: captures of two lengths are timed until their
+// difference spans RATE_CAL_SPAN_MS, so the start latency cancels out
+#define RATE_CAL_SLOTS 32
+#define RATE_CAL_SPAN_MS 500
+#define RATE_CAL_BUFFER_MIN 1024
+#define RATE_CAL_BUFFER_MAX 8192
+#define RATE_CAL_REPEATS_MAX 16
+#define RATE_CAL_TOLERANCE 0.5      // Measured rates further than this from the requested one are discarded
+
+// Smallest signal swing a frequency check times, below it only noise crosses
+#define FREQ_SWING_MIN_MV 50
+
+static uint32_t scope_started_ms = 0;
+static uint32_t scope_wait_ms = 0;
+static size_t scope_buffer_size = 0;
+static double scope_rate_hz = 0;    // Measured rate of the last capture
+static bool wait_timed_out = false;
 bool sigscoper_initialized = false;
 
+/**
+ * @brief Sample rate Sigscoper delivers for a requested one
+ */
+typedef struct {
+    uint8_t unit;         // adc_unit_t
+    uint32_t nominal;     // Requested rate in Hz
+    double actual;        // Measured rate in Hz
+} scope_rate_t;
+
+static scope_rate_t scope_rates[RATE_CAL_SLOTS];
+static size_t scope_rate_count = 0;
+static bool freq_capture = false;   // Last capture was taken by a freq check, the next check takes its own
+
+// Raw samples of the last capture, oldest first, for frequency checks and sweeps
+static uint16_t capture_raw[FREQ_BUFFER_MAX];
+static_assert(SWEEP_BUFFER <= FREQ_BUFFER_MAX, "sweep points must fit the capture buffer");
+
 power_rails_state_t get_power_rails_state(bool* p12v_state, bool* p5v_state, bool* m12v_state) {
-    // Create local variables to store the states
-    bool p12v = mcp1.digitalRead(PIN_P12V_PASS);
-    bool p5v = mcp1.digitalRead(PIN_P5V_PASS);
-    bool m12v = !mcp1.digitalRead(PIN_M12V_PASS); // Inverted signal
+    // State cached by the rail monitor, no I2C access
+    uint8_t rails = hal_rails_state();
+    bool p12v = rails & RAILS_BIT_12V;
+    bool p5v = rails & RAILS_BIT_5V;
+    bool m12v = rails & RAILS_BIT_M12V;
 
     // Only write to output parameters if they are not NULL
     if (p12v_state) *p12v_state = p12v;
@@ -62,11 +113,30 @@ bool perform_startup_sequence() {
         return false;
     }
 
-    // Step 5: Calibrate sensors
-    hal_current_calibrate();
-    hal_adc_calibrate();
+    // Source LUTs measured by calsrc, ideal codes without them
+    hal_source_calibration_load();
+
+    // Step 5: Calibrate sensors, a full run only when the stored one does not fit
+    if (!hal_calibration_load()) {
+        hal_current_calibrate();
+        hal_adc_calibrate();
+        // Offsets measured with a module drawing current would fail every later boot
+        if (hal_rails_state() == 0) {
+            hal_calibration_save();
+        } else {
+            ESP_LOGW(TAG, "Module connected during calibration, not storing it");
+        }
+    }
     
     ESP_LOGI(TAG, "Calibration complete");
+
+    // Scope rates are timed once here instead of in the first test that captures
+    measure_scope_rates();
+
+    // Step 6: Keep the ADC1 sinks converting in the background
+    if (!adc_dma_start()) {
+        ESP_LOGW(TAG, "ADC DMA engine not running, sinks are sampled on demand");
+    }
     
     return true;
 }
@@ -74,8 +144,8 @@ bool perform_startup_sequence() {
 power_rails_state_t wait_for_module_insertion(bool& p12v_ok, bool& p5v_ok, bool& m12v_ok) {
     power_rails_state_t rails_state;
     do {
+        hal_rails_wait(true);
         rails_state = get_power_rails_state(&p12v_ok, &p5v_ok, &m12v_ok);
-        delay(100);
     } while (rails_state != POWER_RAILS_ALL);
     return rails_state;
 }
@@ -83,8 +153,8 @@ power_rails_state_t wait_for_module_insertion(bool& p12v_ok, bool& p5v_ok, bool&
 power_rails_state_t wait_for_module_removal(bool& p12v_ok, bool& p5v_ok, bool& m12v_ok) {
     power_rails_state_t rails_state;
     do {
+        hal_rails_wait(false);
         rails_state = get_power_rails_state(&p12v_ok, &p5v_ok, &m12v_ok);
-        delay(100);
     } while (rails_state != POWER_RAILS_NONE);
     return rails_state;
 }
@@ -92,11 +162,9 @@ power_rails_state_t wait_for_module_removal(bool& p12v_ok, bool& p5v_ok, bool& m
 bool check_current(ina_pin_t pin, const range_t& range, const char* rail_name, int32_t* result) {
     ESP_LOGD(TAG, "Checking current on %s rail", rail_name);
 
-    // Measure current
-    int32_t current_ua = measure_current(pin);
-    
-    // Check if current is within acceptable range
-    bool current_ok = (current_ua >= range.min && current_ua <= range.max);
+    // Measure current, sampling stops early when far from the limits
+    bool current_ok;
+    int32_t current_ua = measure_current_range(pin, range.min, range.max, &current_ok);
 
     if (result) {
         *result = current_ua;
@@ -121,10 +189,9 @@ bool check_initial_current_consumption(const power_rails_current_ranges_t& range
 bool test_pin_range(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result) {
     ESP_LOGD(TAG, "Testing %s", pin_name);
 
-    // Measure voltage for the pin
-    int32_t voltage_mv = hal_adc_read(pin);
-
-    bool voltage_ok = (voltage_mv >= range.min && voltage_mv <= range.max);
+    // Measure voltage for the pin, sampling stops early when far from the limits
+    bool voltage_ok;
+    int32_t voltage_mv = hal_adc_read_range(pin, range.min, range.max, &voltage_ok);
 
     if (result) {
         *result = voltage_mv;
@@ -136,8 +203,63 @@ bool test_pin_range(ADC_sink_t pin, const range_t& range, const char* pin_name,
     return voltage_ok;
 }
 
-bool check_io_level(mcp_io_t pin, int expected_level, const char* level_name, int32_t* result) {
-    ESP_LOGD(TAG, "Checking IO pin %d level", pin);
+// Settling: poll period and number of consecutive readings that must lie within the tolerance
+#define SETTLE_POLL_MS 5
+#define SETTLE_WINDOW 4
+
+// Poll a voltage or current reading until the last SETTLE_WINDOW values agree
+static void settle_common(bool current, int pin, int32_t tolerance, uint32_t timeout_ms,
+                          const char* name, const char* unit, int32_t* result) {
+    int32_t window[SETTLE_WINDOW];
+    size_t count = 0;
+    uint32_t start = millis();
+    bool settled = false;
+    int32_t value = 0;
+
+    while (true) {
+        value = current ? measure_current(pin) : hal_adc_read((ADC_sink_t)pin);
+        window[count % SETTLE_WINDOW] = value;
+        count++;
+
+        if (count >= SETTLE_WINDOW) {
+            int32_t lo = window[0], hi = window[0];
+            for (size_t i = 1; i < SETTLE_WINDOW; i++) {
+                lo = min(lo, window[i]);
+                hi = max(hi, window[i]);
+            }
+            if (hi - lo <= tolerance) {
+                settled = true;
+                break;
+            }
+        }
+        if (millis() - start >= timeout_ms) {
+            break;
+        }
+        delay(SETTLE_POLL_MS);
+    }
+
+    if (result) {
+        *result = value;
+    }
+
+    if (settled) {
+        ESP_LOGI(TAG, "%s settled at %d %s after %lu ms", name, value, unit, millis() - start);
+    } else {
+        ESP_LOGW(TAG, "%s did not settle within %d %s in %lu ms, last reading %d %s",
+                 name, tolerance, unit, timeout_ms, value, unit);
+    }
+}
+
+void settle_pin(ADC_sink_t pin, int32_t tolerance_mv, uint32_t timeout_ms, const char* pin_name, int32_t* result) {
+    settle_common(false, pin, tolerance_mv, timeout_ms, pin_name, "mV", result);
+}
+
+void settle_current(ina_pin_t pin, int32_t tolerance_ua, uint32_t timeout_ms, const char* rail_name, int32_t* result) {
+    settle_common(true, pin, tolerance_ua, timeout_ms, rail_name, "uA", result);
+}
+
+bool check_io_level(mcp_io_t pin, int expected_level, const char* pin_name, const char* level_name, int32_t* result) {
+    ESP_LOGD(TAG, "Checking IO pin %s level", pin_name);
 
     // Read the current level of the IO pin
     int actual_level = mcp0.digitalRead(pin);
@@ -148,12 +270,40 @@ bool check_io_level(mcp_io_t pin, int expected_level, const char* level_name, in
         *result = actual_level;
     }
 
-    ESP_LOGI(TAG, "IO pin %d level: %s %s (expected: %s)",
-             pin, actual_level ? "HIGH" : "LOW", level_ok ? "OK" : "MISMATCH", level_name);
+    ESP_LOGI(TAG, "IO pin %s level: %s %s (expected: %s)",
+             pin_name, actual_level ? "HIGH" : "LOW", level_ok ? "OK" : "MISMATCH", level_name);
 
     return level_ok;
 }
 
+// Levels of the pins in mask as "1"/"0", lowest IO first, "x" for pins skipped inside the span
+static void format_io_levels(uint16_t levels, uint16_t mask, char* buf) {
+    size_t len = 0;
+    for (int pin = 0; pin < 16 && (mask >> pin); pin++) {
+        if (len > 0 || (mask & (1u << pin))) {
+            buf[len++] = !(mask & (1u << pin)) ? 'x' : (levels & (1u << pin)) ? '1' : '0';
+        }
+    }
+    buf[len] = '\0';
+}
+
+bool check_io_levels(uint16_t mask, uint16_t expected, const char* pin_name, int32_t* result) {
+    uint16_t actual = hal_read_io_port() & mask;
+    bool levels_ok = actual == (expected & mask);
+
+    if (result) {
+        *result = actual;
+    }
+
+    char actual_buf[17], expected_buf[17];
+    format_io_levels(actual, mask, actual_buf);
+    format_io_levels(expected, mask, expected_buf);
+    ESP_LOGI(TAG, "IO pins %s levels: %s %s (expected: %s)",
+             pin_name, actual_buf, levels_ok ? "OK" : "MISMATCH", expected_buf);
+
+    return levels_ok;
+}
+
 bool test_pin_pd(const voltage_source_t& source, 
                 const range_t& hiz_range, const range_t& pd_range,
                 const char* source_name) {
@@ -257,14 +407,12 @@ bool test_mode(const int led_pin1, const int led_pin2, const mode_current_ranges
     return false;
 }
 
-// Helper function to map current measurement pin numbers from JSON to actual pins
+// Helper function to map current rails from scripts to actual pins
 int map_current_pin(int pin) {
-    switch (pin) {
-        case 0: return PIN_INA_12V;   // +12V rail
-        case 1: return PIN_INA_5V;    // +5V rail
-        case 2: return PIN_INA_M12V;  // -12V rail
-        default: return pin;           // Return as-is for other pins
+    if (pin >= 0 && pin < CURRENT_RAIL_COUNT) {
+        return script_rail_pin((current_rail_t)pin);
     }
+    return pin; // Return as-is for other pins
 }
 
 bool execute_reset_operation() {
@@ -280,21 +428,25 @@ bool execute_reset_operation() {
     hal_set_source(SOURCE_D, 0);
     
     // 3. Disable all pulldowns
-    // Set pulldown pins to high-Z (input mode)
-    mcp1.pinMode(PIN_SINK_PD_A, OUTPUT);
-    mcp1.pinMode(PIN_SINK_PD_B, OUTPUT);
-    mcp1.pinMode(PIN_SINK_PD_C, OUTPUT);
-
-    mcp1.pinMode(PIN_SINK_PD_A, LOW);
-    mcp1.pinMode(PIN_SINK_PD_B, LOW);
-    mcp1.pinMode(PIN_SINK_PD_C, LOW);
+    // Set pulldown pins to high-Z (input mode), one IODIR write for all three
+    mcp1.setPinMode(PIN_SINK_PD_A, INPUT);
+    mcp1.setPinMode(PIN_SINK_PD_B, INPUT);
+    mcp1.setPinMode(PIN_SINK_PD_C, INPUT);
+    mcp1.flush();
     
     // ESP_LOGI(TAG, "Reset operation completed successfully");
     
-    // Stop Sigscoper if running
-    if (global_sigscoper.is_running()) {
+    // A finished capture may still hold the continuous driver, so Sigscoper
+    // is stopped whatever its state once it has been used
+    if (sigscoper_initialized) {
         global_sigscoper.stop();
     }
+
+    // Sigscoper released the ADC, background conversion takes it back. If it
+    // did not, ADC1 sink readings fail instead of returning analogRead() zeros
+    if (!adc_dma_start()) {
+        ESP_LOGE(TAG, "ADC DMA engine not running after reset");
+    }
     
     return true;
 }
@@ -337,43 +489,36 @@ static adc_channel_t adc_sink_to_channel(ADC_sink_t pin) {
     }
 }
 
-// Helper function to get pin name for display
-static const char* get_pin_name(ADC_sink_t pin) {
-    switch (pin) {
-        case ADC_sink_1k_A: return "A";
-        case ADC_sink_1k_B: return "B";
-        case ADC_sink_1k_C: return "C";
-        case ADC_sink_1k_D: return "D";
-        case ADC_sink_1k_E: return "E";
-        case ADC_sink_1k_F: return "F";
-        case ADC_sink_PD_A: return "pdA";
-        case ADC_sink_PD_B: return "pdB";
-        case ADC_sink_PD_C: return "pdC";
-        case ADC_sink_Z_D: return "zD";
-        case ADC_sink_Z_E: return "zE";
-        case ADC_sink_Z_F: return "zF";
-        default: return "Unknown";
-    }
-}
-
 // Helper function for common signal checking logic
-static bool check_signal_common(ADC_sink_t pin, SigscoperStats* stats) {
+static bool wait_for_capture(ADC_sink_t pin) {
     // Check if scope was started with the same pin
     if (last_scope_pin != pin) {
         ESP_LOGE(TAG, "Scope was not started with pin %s (last pin: %d)", 
-                 get_pin_name(pin), last_scope_pin);
+                 script_sink_name(pin), last_scope_pin);
         return false;
     }
 
-    // ESP_LOGI(TAG, "Checking signal on pin %s", get_pin_name(pin));
+    // ESP_LOGI(TAG, "Checking signal on pin %s", script_sink_name(pin));
     
-    // Wait for acquisition to complete
+    // Wait for acquisition to complete, bounded so a stuck capture cannot stall the station
     while (!global_sigscoper.is_ready()) {
+        if (millis() - scope_started_ms > scope_wait_ms) {
+            ESP_LOGE(TAG, "Capture on pin %s did not complete within %lu ms", script_sink_name(pin), scope_wait_ms);
+            wait_timed_out = true;
+            return false;
+        }
         delay(10);
     }
 
-    // ESP_LOGI(TAG, "Acquisition completed for pin %s", get_pin_name(pin));
-    
+    // ESP_LOGI(TAG, "Acquisition completed for pin %s", script_sink_name(pin));
+    return true;
+}
+
+static bool check_signal_common(ADC_sink_t pin, SigscoperStats* stats) {
+    if (!wait_for_capture(pin)) {
+        return false;
+    }
+
     // Get statistics
     if (!global_sigscoper.get_stats(0, stats)) {
         ESP_LOGE(TAG, "Failed to get statistics from Sigscoper");
@@ -383,20 +528,8 @@ static bool check_signal_common(ADC_sink_t pin, SigscoperStats* stats) {
     return true;
 }
 
-// Function to start Sigscoper in FREE mode
-bool start_sigscoper(ADC_sink_t pin, uint32_t sample_freq, size_t buffer_size) {
-    ESP_LOGD(TAG, "Starting Sigscoper on pin %s, freq: %d Hz, buffer: %d", 
-             get_pin_name(pin), sample_freq, buffer_size);
-    
-    // Initialize Sigscoper if not already done
-    if (!sigscoper_initialized) {
-        if (!global_sigscoper.begin()) {
-            ESP_LOGE(TAG, "Failed to initialize Sigscoper");
-            return false;
-        }
-        sigscoper_initialized = true;
-    }
-    
+// Configure Sigscoper in FREE mode and start a capture
+static bool sigscoper_capture(ADC_sink_t pin, uint32_t sample_freq, size_t buffer_size) {
     // Wait for previous acquisition
     if (global_sigscoper.is_running()) {
         global_sigscoper.stop();
@@ -418,16 +551,212 @@ bool start_sigscoper(ADC_sink_t pin, uint32_t sample_freq, size_t buffer_size) {
         ESP_LOGE(TAG, "Failed to start Sigscoper");
         return false;
     }
+    return true;
+}
+
+// Time from the start of a capture of count samples until it is ready, in
+// microseconds, or -1 if it fails or takes more than twice its nominal length
+static int64_t time_capture(ADC_sink_t pin, uint32_t sample_freq, size_t count) {
+    int64_t started = esp_timer_get_time();
+    if (!sigscoper_capture(pin, sample_freq, count)) {
+        return -1;
+    }
+    int64_t limit = started + 2 * (int64_t)count * 1000000 / sample_freq + SCOPE_WAIT_MARGIN_MS * 1000;
+    while (!global_sigscoper.is_ready()) {
+        if (esp_timer_get_time() > limit) {
+            return -1;
+        }
+        delay(1);
+    }
+    return esp_timer_get_time() - started;
+}
+
+// Measured rate for sample_freq on the ADC of pin, nullptr if it was not measured
+static const scope_rate_t* find_scope_rate(ADC_sink_t pin, uint32_t sample_freq) {
+    uint8_t unit = adc_sink_to_unit(pin);
+    for (size_t i = 0; i < scope_rate_count; i++) {
+        if (scope_rates[i].unit == unit && scope_rates[i].nominal == sample_freq) {
+            return &scope_rates[i];
+        }
+    }
+    return nullptr;
+}
+
+// Time Sigscoper at sample_freq on the ADC of pin against esp_timer and store
+// the rate it actually delivers; the ADC clock dividers only approximate the request
+static void measure_scope_rate(ADC_sink_t pin, uint32_t sample_freq) {
+    uint8_t unit = adc_sink_to_unit(pin);
+    if (scope_rate_count >= RATE_CAL_SLOTS) {
+        ESP_LOGW(TAG, "No room to time Sigscoper at %lu Hz, captures assume the requested rate", (unsigned long)sample_freq);
+        return;
+    }
+
+    // The 1 ms polling error is random per capture and averages over the repeats
+    size_t longer = std::min(std::max((size_t)(sample_freq / 10), (size_t)RATE_CAL_BUFFER_MIN), (size_t)RATE_CAL_BUFFER_MAX);
+    size_t shorter = longer / 4;
+    int repeats = (int)ceil(RATE_CAL_SPAN_MS * (double)sample_freq / (1000.0 * (longer - shorter)));
+    repeats = constrain(repeats, 1, RATE_CAL_REPEATS_MAX);
+    int64_t span_us = 0;
+    double actual = sample_freq;
+    for (int r = 0; r < repeats; r++) {
+        int64_t long_us = time_capture(pin, sample_freq, longer);
+        int64_t short_us = time_capture(pin, sample_freq, shorter);
+        if (long_us < 0 || short_us < 0) {
+            ESP_LOGW(TAG, "Could not time Sigscoper at %lu Hz, assuming the requested rate", (unsigned long)sample_freq);
+            span_us = -1;
+            break;
+        }
+        span_us += long_us - short_us;
+    }
+    if (span_us >= 0) {
+        actual = span_us > 0 ? 1e6 * repeats * (longer - shorter) / span_us : 0;
+        if (fabs(actual / sample_freq - 1) > RATE_CAL_TOLERANCE) {
+            ESP_LOGW(TAG, "Sigscoper at %lu Hz timed at %.1f Hz, assuming the requested rate", (unsigned long)sample_freq, actual);
+            actual = sample_freq;
+        } else {
+            ESP_LOGI(TAG, "Sigscoper at %lu Hz on ADC%d samples at %.1f Hz", (unsigned long)sample_freq, unit + 1, actual);
+        }
+    }
+
+    // Stored even when timing failed, so the rate is not retried on every insertion
+    scope_rate_t& slot = scope_rates[scope_rate_count++];
+    slot.unit = unit;
+    slot.nominal = sample_freq;
+    slot.actual = actual;
+}
+
+static bool sigscoper_begin() {
+    if (!sigscoper_initialized) {
+        if (!global_sigscoper.begin()) {
+            ESP_LOGE(TAG, "Failed to initialize Sigscoper");
+            return false;
+        }
+        sigscoper_initialized = true;
+    }
+    return true;
+}
+
+/**
+ * @brief Progress of measure_scope_rates()
+ */
+typedef struct {
+    bool started;         // Sigscoper holds the ADC for the measurements
+    bool failed;          // Sigscoper could not start, nothing is timed
+} rate_plan_t;
+
+static void plan_scope_rate(rate_plan_t* plan, ADC_sink_t pin, uint32_t sample_freq) {
+    if (plan->failed || pin >= ADC_sink_count || sample_freq == 0 || find_scope_rate(pin, sample_freq)) {
+        return;
+    }
+    if (!plan->started) {
+        if (!sigscoper_begin()) {
+            plan->failed = true;
+            return;
+        }
+        adc_dma_stop(true);
+        plan->started = true;
+    }
+    measure_scope_rate(pin, sample_freq);
+}
+
+void measure_scope_rates() {
+    uint32_t start_time = millis();
+    rate_plan_t plan = {false, false};
+    const module_info_t* all = get_modules_array();
+    for (size_t m = 0; all && m < get_modules_count(); m++) {
+        for (size_t i = 0; i < all[m].test_operations_count; i++) {
+            const test_operation_t& op = all[m].test_operations[i];
+            switch (op.op) {
+                case TEST_OP_SCOPE:
+                    plan_scope_rate(&plan, (ADC_sink_t)op.pin, op.arg1);
+                    break;
+                case TEST_OP_CHECK_FREQ:
+                    plan_scope_rate(&plan, (ADC_sink_t)op.pin, freq_capture_rate(op.arg2));
+                    break;
+                case TEST_OP_SWEEP: {
+                    // Same points as run_freq_sweep()
+                    int points = constrain((int)SWEEP_ARG1_POINTS(op.arg1), 2, SWEEP_POINTS_MAX);
+                    for (int p = 0; p < points; p++) {
+                        double freq = sweep_point_freq(op.arg2, op.arg3, points, p);
+                        plan_scope_rate(&plan, (ADC_sink_t)SWEEP_ARG1_SINK(op.arg1), sweep_sample_rate(freq));
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+    if (!plan.started) {
+        return;
+    }
+
+    // Leave the ADC as a reset does
+    global_sigscoper.stop();
+    last_scope_pin = -1;
+    if (!adc_dma_start()) {
+        ESP_LOGW(TAG, "ADC DMA engine not running after timing Sigscoper");
+    }
+    ESP_LOGI(TAG, "Timed %zu scope rates in %lu ms", scope_rate_count, millis() - start_time);
+}
+
+// Function to start Sigscoper in FREE mode
+bool start_sigscoper(ADC_sink_t pin, uint32_t sample_freq, size_t buffer_size) {
+    ESP_LOGD(TAG, "Starting Sigscoper on pin %s, freq: %d Hz, buffer: %d", 
+             script_sink_name(pin), sample_freq, buffer_size);
+    if (sample_freq == 0 || buffer_size == 0) {
+        ESP_LOGE(TAG, "Sigscoper needs a sample rate and a buffer size");
+        return false;
+    }
+    
+    // Only one continuous ADC user at a time, the engine resumes on reset
+    adc_dma_stop(adc_sink_to_unit(pin) == ADC_UNIT_1);
+    
+    if (!sigscoper_begin()) {
+        return false;
+    }
+
+    // Rates are timed by measure_scope_rates() when the scripts load, never here
+    const scope_rate_t* rate = find_scope_rate(pin, sample_freq);
+    double actual_rate = rate ? rate->actual : sample_freq;
+    if (!rate) {
+        ESP_LOGW(TAG, "Sigscoper at %lu Hz was not timed, assuming the requested rate", (unsigned long)sample_freq);
+    }
+    if (!sigscoper_capture(pin, sample_freq, buffer_size)) {
+        return false;
+    }
     
     last_scope_pin = pin;
+    freq_capture = false;
+    scope_started_ms = millis();
+    scope_wait_ms = (uint32_t)(buffer_size * 1000 / actual_rate) + SCOPE_WAIT_MARGIN_MS;
+    scope_buffer_size = buffer_size;
+    scope_rate_hz = actual_rate;
     // ESP_LOGI(TAG, "Sigscoper started successfully");
     return true;
 }
 
+// Wait for the capture on pin and copy up to max of its samples, oldest first
+static bool read_capture(ADC_sink_t pin, uint16_t* samples, size_t max, size_t* count) {
+    if (!wait_for_capture(pin)) {
+        return false;
+    }
+    size_t n = std::min(scope_buffer_size, max);
+    size_t position = 0;
+    if (!global_sigscoper.get_buffer(0, n, samples, &position)) {
+        ESP_LOGE(TAG, "Failed to read the capture from Sigscoper");
+        return false;
+    }
+    // Sigscoper hands out its ring as is, position is the next sample it would write
+    std::rotate(samples, samples + position % n, samples + n);
+    *count = n;
+    return true;
+}
+
 
 
 // Function to check signal minimum value
-bool check_signal_min(ADC_sink_t pin, const range_t& range, int32_t* result) {
+bool check_signal_min(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result) {
     SigscoperStats stats;
     if (!check_signal_common(pin, &stats)) {
         return false;
@@ -443,13 +772,13 @@ bool check_signal_min(ADC_sink_t pin, const range_t& range, int32_t* result) {
     }
     
     ESP_LOGI(TAG, "min on pin %s: %d %s (acceptable range: %d-%d)",
-             get_pin_name(pin), value, value_ok ? "OK" : "OUT OF RANGE", range.min, range.max);
+             pin_name, value, value_ok ? "OK" : "OUT OF RANGE", range.min, range.max);
     
     return value_ok;
 }
 
 // Function to check signal maximum value
-bool check_signal_max(ADC_sink_t pin, const range_t& range, int32_t* result) {    
+bool check_signal_max(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result) {    
     SigscoperStats stats;
     if (!check_signal_common(pin, &stats)) {
         return false;
@@ -465,14 +794,14 @@ bool check_signal_max(ADC_sink_t pin, const range_t& range, int32_t* result) {
     }
     
     ESP_LOGI(TAG, "max on pin %s: %d %s (acceptable range: %d-%d)",
-             get_pin_name(pin), value, value_ok ? "OK" : "OUT OF RANGE", range.min, range.max);
+             pin_name, value, value_ok ? "OK" : "OUT OF RANGE", range.min, range.max);
     
     return value_ok;
 }
 
 // Function to check signal average value
-bool check_signal_avg(ADC_sink_t pin, const range_t& range, int32_t* result) {
-    ESP_LOGI(TAG, "Checking avg on pin %s", get_pin_name(pin));
+bool check_signal_avg(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result) {
+    ESP_LOGI(TAG, "Checking avg on pin %s", pin_name);
     
     SigscoperStats stats;
     if (!check_signal_common(pin, &stats)) {
@@ -489,37 +818,58 @@ bool check_signal_avg(ADC_sink_t pin, const range_t& range, int32_t* result) {
     }
     
     ESP_LOGI(TAG, "avg on pin %s: %d %s (acceptable range: %d-%d)",
-             get_pin_name(pin), value, value_ok ? "OK" : "OUT OF RANGE", range.min, range.max);
+             pin_name, value, value_ok ? "OK" : "OUT OF RANGE", range.min, range.max);
     
     return value_ok;
 }
 
 // Function to check signal frequency
-bool check_signal_freq(ADC_sink_t pin, const range_t& range, int32_t* result) {
-    SigscoperStats stats;
-    if (!check_signal_common(pin, &stats)) {
+bool check_signal_freq(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result) {
+    if (result) {
+        *result = 0;
+    }
+
+    // Without a scope on the pin, the capture is planned from the expected range.
+    // A capture an earlier freq check took is not reused: in a loop or a retry it
+    // would hold the signal of a previous pass
+    if (last_scope_pin != pin || freq_capture) {
+        uint32_t rate = freq_capture_rate(range.max);
+        if (!start_sigscoper(pin, rate, freq_capture_buffer(rate, range.min))) {
+            return false;
+        }
+        freq_capture = true;
+    }
+
+    size_t count = 0;
+    if (!read_capture(pin, capture_raw, FREQ_BUFFER_MAX, &count)) {
         return false;
     }
-    
-    float value = stats.frequency;
-    // for some reason, fs at 20k looks like 16384
-    value = value * 16384 / 20000;
-    
-    // Store result value (convert float to int32_t)
+    auto extremes = std::minmax_element(capture_raw, capture_raw + count);
+    int32_t swing = abs(hal_adc_raw2mv(*extremes.second, pin) - hal_adc_raw2mv(*extremes.first, pin));
+    freq_estimate_t estimate = freq_estimate(capture_raw, count);
+    if (swing < FREQ_SWING_MIN_MV || estimate.periods == 0) {
+        ESP_LOGE(TAG, "freq on pin %s: no periodic signal, %d mV swing and %u periods in %u samples",
+                 pin_name, swing, (unsigned)estimate.periods, (unsigned)count);
+        return false;
+    }
+
+    double value = estimate.freq * scope_rate_hz;
     if (result) {
-        *result = (int32_t)value;
+        *result = lround(value);
     }
 
     bool value_ok = (value >= range.min && value <= range.max);
     
     ESP_LOGI(TAG, "freq on pin %s: %.2f %s (acceptable range: %d-%d)",
-             get_pin_name(pin), value, value_ok ? "OK" : "OUT OF RANGE", range.min, range.max);
+             pin_name, value, value_ok ? "OK" : "OUT OF RANGE", range.min, range.max);
+    ESP_LOGD(TAG, "freq on pin %s: %u periods at %.1f Hz, period jitter %.2f%%%s", pin_name, (unsigned)estimate.periods,
+             scope_rate_hz, 100 * estimate.jitter, estimate.refined ? ", refined by Goertzel" : "");
     
     return value_ok;
 }
 
 // Function to check signal amplitude (max - min)
-bool check_signal_amplitude(ADC_sink_t pin, const range_t& range, int32_t* result) {
+bool check_signal_amplitude(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result) {
     SigscoperStats stats;
     if (!check_signal_common(pin, &stats)) {
         return false;
@@ -536,7 +886,7 @@ bool check_signal_amplitude(ADC_sink_t pin, const range_t& range, int32_t* resul
     bool amplitude_ok = (amplitude >= range.min && amplitude <= range.max);
     
     ESP_LOGI(TAG, "amplitude on pin %s: %d %s (acceptable range: %d-%d)",
-             get_pin_name(pin), amplitude, amplitude_ok ? "OK" : "OUT OF RANGE", range.min, range.max);
+             pin_name, amplitude, amplitude_ok ? "OK" : "OUT OF RANGE", range.min, range.max);
 
     if(!amplitude_ok) {
         // print the buffer
@@ -550,4 +900,188 @@ bool check_signal_amplitude(ADC_sink_t pin, const range_t& range, int32_t* resul
     }
     
     return amplitude_ok;
-} 
\ No newline at end of file
+} 
+
+/**
+ * @brief Points measured by the last sweep, read by the sweep checks
+ */
+typedef struct {
+    int sink;                          // -1 until a sweep completes
+    int count;
+    float freq[SWEEP_POINTS_MAX];      // Hz
+    float gain_db[SWEEP_POINTS_MAX];   // Against the generated amplitude
+    float phase_deg[SWEEP_POINTS_MAX]; // Against the generated phase at the capture start
+} sweep_points_t;
+
+static sweep_points_t last_sweep = {-1, 0, {}, {}, {}};
+static float sweep_mv[SWEEP_BUFFER];
+
+static void sweep_stimulus(source_net_t source, double freq) {
+    signal_wave_t wave = {SIGNAL_SINE, SWEEP_AMPLITUDE_MV, 0, 50};
+    hal_start_signal(source, freq, &wave);
+}
+
+bool run_freq_sweep(source_net_t source, ADC_sink_t sink, int32_t start_mhz, int32_t stop_mhz, int points,
+                    const char* pin_name, int32_t* result) {
+    last_sweep.sink = -1;
+    last_sweep.count = 0;
+    if (result) {
+        *result = 0;
+    }
+    points = constrain(points, 2, SWEEP_POINTS_MAX);
+
+    double freq = sweep_point_freq(start_mhz, stop_mhz, points, 0);
+    sweep_stimulus(source, freq);
+    uint32_t settle_until = millis() + sweep_settle_ms(freq);
+    bool ok = true;
+    for (int i = 0; i < points; i++) {
+        while ((int32_t)(millis() - settle_until) < 0) {
+            delay(1);
+        }
+        size_t count = 0;
+        if (!start_sigscoper(sink, sweep_sample_rate(freq), SWEEP_BUFFER)) {
+            ok = false;
+            break;
+        }
+        uint32_t start_phase = hal_signal_phase(source);
+        if (!read_capture(sink, capture_raw, SWEEP_BUFFER, &count)) {
+            ok = false;
+            break;
+        }
+
+        // The next point settles while this one is computed
+        double point_freq = freq;
+        if (i + 1 < points) {
+            freq = sweep_point_freq(start_mhz, stop_mhz, points, i + 1);
+            sweep_stimulus(source, freq);
+            settle_until = millis() + sweep_settle_ms(freq);
+        }
+
+        for (size_t n = 0; n < count; n++) {
+            sweep_mv[n] = hal_adc_raw2mv(capture_raw[n], sink);
+        }
+        goertzel_result_t tone = goertzel(sweep_mv, count, point_freq / scope_rate_hz);
+
+        // The generator holds every sample for a timer tick: sin(x)/x droop and half a tick of delay
+        double hold = M_PI * point_freq / SWEEP_GENERATOR_RATE;
+        double generated_mv = SWEEP_AMPLITUDE_MV * sin(hold) / hold;
+        double gain_db = 20 * log10(std::max((double)tone.amplitude, 0.001) / generated_mv);
+        // The stimulus is the sine of the accumulator, a cosine 90 degrees behind it
+        double stimulus = start_phase * (2 * M_PI / 4294967296.0) - M_PI / 2 - hold;
+        double phase = remainder(tone.phase - stimulus, 2 * M_PI);
+
+        last_sweep.freq[i] = point_freq;
+        last_sweep.gain_db[i] = gain_db;
+        last_sweep.phase_deg[i] = phase * 180 / M_PI;
+        last_sweep.count = i + 1;
+        ESP_LOGI(TAG, "sweep on pin %s: %.2f Hz, %.2f dB, %.0f deg", pin_name, point_freq, gain_db,
+                 last_sweep.phase_deg[i]);
+    }
+    hal_stop_signal(source);
+
+    // Scope checks need a capture of their own, the one left in Sigscoper is the last point
+    last_scope_pin = -1;
+    if (result) {
+        *result = last_sweep.count;
+    }
+    if (!ok) {
+        ESP_LOGE(TAG, "sweep on pin %s stopped after %d of %d points", pin_name, last_sweep.count, points);
+        return false;
+    }
+    last_sweep.sink = sink;
+    return true;
+}
+
+static bool sweep_measured(ADC_sink_t pin) {
+    if (last_sweep.sink != pin) {
+        ESP_LOGE(TAG, "No sweep was completed on pin %s", script_sink_name(pin));
+        return false;
+    }
+    return true;
+}
+
+// Point at which the gain first falls SWEEP_CUTOFF_DB below the first point, or -1
+static int sweep_cutoff_index() {
+    float level = last_sweep.gain_db[0] - SWEEP_CUTOFF_DB;
+    for (int i = 1; i < last_sweep.count; i++) {
+        if (last_sweep.gain_db[i] < level) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool check_sweep_value(const char* what, int32_t value, const range_t& range, const char* pin_name, int32_t* result) {
+    bool value_ok = (value >= range.min && value <= range.max);
+    if (result) {
+        *result = value;
+    }
+    ESP_LOGI(TAG, "%s on pin %s: %d %s (acceptable range: %d-%d)",
+             what, pin_name, value, value_ok ? "OK" : "OUT OF RANGE", range.min, range.max);
+    return value_ok;
+}
+
+bool check_sweep_cutoff(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result) {
+    if (!sweep_measured(pin)) {
+        return false;
+    }
+    int i = sweep_cutoff_index();
+    if (i < 0) {
+        ESP_LOGE(TAG, "cutoff on pin %s: gain stays within %.0f dB of the first point", pin_name, SWEEP_CUTOFF_DB);
+        return false;
+    }
+
+    // Interpolated on the log frequency axis between the points around the crossing
+    float level = last_sweep.gain_db[0] - SWEEP_CUTOFF_DB;
+    float t = (last_sweep.gain_db[i - 1] - level) / (last_sweep.gain_db[i - 1] - last_sweep.gain_db[i]);
+    double cutoff = last_sweep.freq[i - 1] * pow(last_sweep.freq[i] / last_sweep.freq[i - 1], t);
+    return check_sweep_value("cutoff", lround(cutoff), range, pin_name, result);
+}
+
+bool check_sweep_slope(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result) {
+    if (!sweep_measured(pin)) {
+        return false;
+    }
+
+    // Least squares line of gain over log10(frequency), past the knee of the response
+    int first = sweep_cutoff_index();
+    float level = last_sweep.gain_db[0] - SWEEP_SLOPE_DEPTH_DB;
+    int n = 0;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (int i = first < 0 ? last_sweep.count : first; i < last_sweep.count; i++) {
+        if (last_sweep.gain_db[i] > level) {
+            continue;
+        }
+        double x = log10(last_sweep.freq[i]);
+        double y = last_sweep.gain_db[i];
+        n++;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    if (n < 2) {
+        ESP_LOGE(TAG, "slope on pin %s: %d points lie %.0f dB below the first one, 2 needed",
+                 pin_name, n, SWEEP_SLOPE_DEPTH_DB);
+        return false;
+    }
+    double slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    return check_sweep_value("slope", lround(slope), range, pin_name, result);
+}
+
+bool check_sweep_peak(ADC_sink_t pin, const range_t& range, const char* pin_name, int32_t* result) {
+    if (!sweep_measured(pin)) {
+        return false;
+    }
+    float peak = last_sweep.gain_db[0];
+    for (int i = 1; i < last_sweep.count; i++) {
+        peak = std::max(peak, last_sweep.gain_db[i]);
+    }
+    return check_sweep_value("peak", lround(10 * (peak - last_sweep.gain_db[0])), range, pin_name, result);
+}
+
+bool take_wait_timeout() {
+    bool timed_out = wait_timed_out;
+    wait_timed_out = false;
+    return timed_out;
+}
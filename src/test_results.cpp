@@ -1,4 +1,5 @@
 #include "test_results.h"
+#include "script_registry.h"
 #include "modules.h"
 #include "display.h"
 #include "esp_log.h"
@@ -8,25 +9,49 @@ static const char* TAG = "test_results";
 
 // Global variables for test results management
 static test_operation_result_t* global_test_results = nullptr;
+static size_t global_test_results_capacity = 0;
 static module_info_t* current_module = nullptr;
 
+#define TEST_STATUS_NAME(status, name) name,
+static const char* const test_status_names[] = {
+    TEST_STATUSES(TEST_STATUS_NAME)
+};
+#undef TEST_STATUS_NAME
+
+// A group passes when every operation in it passed
+static bool group_passed(const test_group_t* group) {
+    for (size_t j = group->first_op; j < group->end_op; j++) {
+        if (!global_test_results[j].passed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const char* test_status_name(uint8_t status) {
+    return status < sizeof(test_status_names) / sizeof(test_status_names[0]) ? test_status_names[status] : "unknown";
+}
+
 bool allocate_test_results_arrays(module_info_t* module) {
     ESP_LOGD(TAG, "Allocating test results array for module: %s", module ? module->name : "NULL");
     
     // Set current module
     current_module = module;
     
-    // Allocate memory for test results
-    if (module->test_operations_count > 0) {
-        global_test_results = (test_operation_result_t*)malloc(module->test_operations_count * sizeof(test_operation_result_t));
-        if (!global_test_results) {
+    // The array is shared by all modules and only grows, so switching modules does not allocate
+    if (module->test_operations_count > global_test_results_capacity) {
+        test_operation_result_t* results = (test_operation_result_t*)realloc(global_test_results, module->test_operations_count * sizeof(test_operation_result_t));
+        if (!results) {
             ESP_LOGE(TAG, "Failed to allocate test results for module %s", module->name);
             return false;
         }
+        global_test_results = results;
+        global_test_results_capacity = module->test_operations_count;
         ESP_LOGD(TAG, "Allocated %zu test results for module %s", module->test_operations_count, module->name);
-    } else {
+    }
+    
+    if (module->test_operations_count == 0) {
         ESP_LOGW(TAG, "Module %s has no test operations", module->name);
-        global_test_results = nullptr;
     }
     
     ESP_LOGD(TAG, "Test results array allocated for module: %s", module->name);
@@ -41,6 +66,7 @@ void reset_all_test_results() {
     
     for (size_t j = 0; j < current_module->test_operations_count; j++) {
         global_test_results[j].passed = false;
+        global_test_results[j].status = TEST_STATUS_NONE;
         global_test_results[j].result = 0;
         global_test_results[j].execution_time_ms = 0;
     }
@@ -56,30 +82,31 @@ void print_all_test_results() {
     
     ESP_LOGI(TAG, "Module: %s (ID: %d)", current_module->name, current_module->id);
     
+    const test_group_t* group = nullptr;
     for (size_t j = 0; j < current_module->test_operations_count; j++) {
         const test_operation_t& op = current_module->test_operations[j];
         const test_operation_result_t& res = global_test_results[j];
+        if (script_op_is_control(op.op)) {
+            continue;
+        }
+        
+        const test_group_t* op_group = get_operation_group(current_module, j);
+        if (op_group && op_group != group) {
+            group = op_group;
+            ESP_LOGI(TAG, "  Group '%s': %s", group->name, group_passed(group) ? "PASSED" : "FAILED");
+        }
         
-        ESP_LOGI(TAG, "  Operation %zu: %s (pin: %d, arg1: %ld, arg2: %ld)", 
+        char pin_buf[8];
+        const char* pin_name = get_operation_pin_name(current_module, op, pin_buf, sizeof(pin_buf));
+        
+        ESP_LOGI(TAG, "  Operation %zu: %s (pin: %s, arg1: %ld, arg2: %ld)", 
                  j, 
-                 (op.op == TEST_OP_SOURCE) ? "SOURCE" :
-                 (op.op == TEST_OP_IO) ? "IO" :
-                 (op.op == TEST_OP_SINK_PD) ? "SINK_PD" :
-                 (op.op == TEST_OP_CHECK_CURRENT) ? "CHECK_CURRENT" :
-                 (op.op == TEST_OP_CHECK_PIN) ? "CHECK_PIN" :
-                 (op.op == TEST_OP_RESET) ? "RESET" :
-                 (op.op == TEST_OP_SOURCE_SIG) ? "SOURCE_SIG" :
-                 (op.op == TEST_OP_CHECK_MIN) ? "CHECK_MIN" :
-                 (op.op == TEST_OP_CHECK_MAX) ? "CHECK_MAX" :
-                 (op.op == TEST_OP_CHECK_AVG) ? "CHECK_AVG" :
-                 (op.op == TEST_OP_CHECK_FREQ) ? "CHECK_FREQ" :
-                 (op.op == TEST_OP_CHECK_AMPLITUDE) ? "CHECK_AMPLITUDE" :
-                 (op.op == TEST_OP_DELAY) ? "DELAY" :
-                 "UNKNOWN",
-                 op.pin, op.arg1, op.arg2);
+                 script_op_name(op.op),
+                 pin_name ? pin_name : "-", op.arg1, op.arg2);
         
-        ESP_LOGI(TAG, "    Flag: %s, Result: %ld, Time: %lu ms", 
+        ESP_LOGI(TAG, "    Flag: %s, Status: %s, Result: %ld, Time: %lu ms", 
                  res.passed ? "TRUE" : "FALSE", 
+                 test_status_name(res.status),
                  res.result,
                  res.execution_time_ms);
     }
@@ -95,14 +122,19 @@ void display_all_test_results() {
     // Check if all tests passed
     bool all_passed = true;
     size_t first_failed_op = 0;
+    size_t failed_step = 0;     // Position among non-control operations, as the script lists them
+    size_t step = 0;
     
     for (size_t j = 0; j < current_module->test_operations_count; j++) {
+        if (script_op_is_control(current_module->test_operations[j].op)) {
+            continue;
+        }
+        step++;
         const test_operation_result_t& res = global_test_results[j];
-        if (!res.passed) {
+        if (!res.passed && all_passed) {
             all_passed = false;
-            if (first_failed_op == 0 || j < first_failed_op) {
-                first_failed_op = j;
-            }
+            first_failed_op = j;
+            failed_step = step;
         }
     }
     
@@ -115,26 +147,24 @@ void display_all_test_results() {
         const test_operation_t& failed_op = current_module->test_operations[first_failed_op];
         const test_operation_result_t& failed_res = global_test_results[first_failed_op];
         
-        const char* op_name = 
-            (failed_op.op == TEST_OP_SOURCE) ? "SOURCE" :
-            (failed_op.op == TEST_OP_IO) ? "IO" :
-            (failed_op.op == TEST_OP_SINK_PD) ? "SINK_PD" :
-            (failed_op.op == TEST_OP_CHECK_CURRENT) ? "CHECK_CURRENT" :
-            (failed_op.op == TEST_OP_CHECK_PIN) ? "CHECK_PIN" :
-            (failed_op.op == TEST_OP_RESET) ? "RESET" :
-            (failed_op.op == TEST_OP_SOURCE_SIG) ? "SOURCE_SIG" :
-            (failed_op.op == TEST_OP_CHECK_MIN) ? "CHECK_MIN" :
-            (failed_op.op == TEST_OP_CHECK_MAX) ? "CHECK_MAX" :
-            (failed_op.op == TEST_OP_CHECK_AVG) ? "CHECK_AVG" :
-            (failed_op.op == TEST_OP_CHECK_FREQ) ? "CHECK_FREQ" :
-            (failed_op.op == TEST_OP_CHECK_AMPLITUDE) ? "CHECK_AMPLITUDE" :
-            (failed_op.op == TEST_OP_DELAY) ? "DELAY" :
-            "UNKNOWN";
+        const char* op_name = script_op_name(failed_op.op);
+        
+        char pin_buf[8];
+        const char* pin_name = get_operation_pin_name(current_module, failed_op, pin_buf, sizeof(pin_buf));
         
-        display_printf("TEST FAILED\nOp %zu: %s\nPin: %d Args: %ld,%ld\nResult: %ld", 
-                      first_failed_op + 1, op_name, 
-                      failed_op.pin, failed_op.arg1, failed_op.arg2,
-                      failed_res.result);
+        // Name the failed group so the operator knows which section to look at
+        const test_group_t* group = get_operation_group(current_module, first_failed_op);
+        
+        if (failed_res.status == TEST_STATUS_TIMEOUT) {
+            display_printf("TEST TIMEOUT\n%.21s\nOp %zu: %s\nPin: %s Args: %ld,%ld", 
+                          group ? group->name : "", failed_step, op_name, 
+                          pin_name ? pin_name : "-", failed_op.arg1, failed_op.arg2);
+        } else {
+            display_printf("TEST FAILED\n%.21s\nOp %zu: %s\nPin: %s Args: %ld,%ld\nResult: %ld", 
+                          group ? group->name : "", failed_step, op_name, 
+                          pin_name ? pin_name : "-", failed_op.arg1, failed_op.arg2,
+                          failed_res.result);
+        }
         // mcp1.digitalWrite(PIN_LED_OK, LOW);
         // mcp1.digitalWrite(PIN_LED_FAIL, HIGH);
     }
@@ -167,9 +197,22 @@ void save_all_test_results() {
     file.println(current_module->name);
     
     // Write results for each operation
+    // Loop markers have no result, readers map lines to non-control operations
     for (size_t j = 0; j < current_module->test_operations_count; j++) {
+        if (script_op_is_control(current_module->test_operations[j].op)) {
+            continue;
+        }
         const test_operation_result_t& res = global_test_results[j];
-        file.printf("%s %ld %lu\n", res.passed ? "true" : "false", res.result, res.execution_time_ms);
+        file.printf("%s %ld %lu status=%s", res.passed ? "true" : "false", res.result, res.execution_time_ms,
+                    test_status_name(res.status));
+        
+        // Pin name (alias if the script declares one) for readers that need it
+        char pin_buf[8];
+        const char* pin_name = get_operation_pin_name(current_module, current_module->test_operations[j], pin_buf, sizeof(pin_buf));
+        if (pin_name) {
+            file.printf(" pin=%s", pin_name);
+        }
+        file.print("\n");
     }
     
     file.close();
@@ -0,0 +1,344 @@
+#include "wave_player.h"
+#include "script_parser.h"
+#include "esp_log.h"
+#include <LittleFS.h>
+#include <cstring>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+static const char* TAG = "wave";
+
+#define WAVE_NAME_MAX      (SCRIPT_WAVE_NAME_MAX + 1)
+#define WAVE_TASK_PRIORITY 4    // Below signal_task, which plays what it loads
+#define WAVE_TASK_IDLE_MS  10   // Refill check without a notification, in case one is missed
+
+/**
+ * @brief File loaded into the pool
+ */
+typedef struct {
+    uint32_t hash;        // FNV-1a hash of the file name
+    uint32_t offset;      // First sample in the pool
+    uint32_t length;      // Samples
+} wave_resident_t;
+
+/**
+ * @brief Playback state of one source
+ *
+ * A stream block belongs to the loader while its length is 0 and to the
+ * player otherwise: the loader publishes a block by setting its length, the
+ * player hands it back by clearing it.
+ */
+typedef struct {
+    bool active;
+    bool loop;
+    bool done;                       // Played once, holding the last sample
+    const int16_t* samples;          // Resident file, nullptr while streaming
+    uint32_t length;                 // Samples of a resident file
+    uint32_t index;                  // Current sample in the file or in the block
+    char name[WAVE_NAME_MAX];
+    File file;                       // Open while streaming
+    int16_t* blocks[2];
+    volatile uint16_t block_len[2];
+    volatile bool eof;               // Loader read the last sample of a file played once
+    uint8_t block;                   // Block being played
+    uint32_t underruns;              // Ticks the player waited for a block
+} wave_state_t;
+
+static int16_t* pool = NULL;         // WAVE_POOL_SAMPLES resident samples, then two stream blocks per source
+static uint32_t pool_used = 0;
+static wave_resident_t residents[WAVE_POOL_FILES];
+static size_t resident_count = 0;
+static bool pool_stale = false;      // A file changed, residents are dropped once none plays
+static wave_state_t waves[SOURCE_COUNT];
+static SemaphoreHandle_t wave_mutex = NULL;  // Files, the pool and playback setup; never taken by the player
+static TaskHandle_t wave_task_handle = NULL;
+
+// Read the next block of a stream, rewinding a looped file at its end.
+// The caller holds wave_mutex.
+static void wave_fill(wave_state_t& s, int b) {
+    uint8_t* dst = (uint8_t*)s.blocks[b];
+    size_t want = WAVE_STREAM_BLOCK * sizeof(int16_t);
+    size_t filled = 0;
+    bool rewound = false;
+    while (filled < want) {
+        size_t n = s.file.read(dst + filled, want - filled);
+        if (n == 0) {
+            if (!s.loop || rewound) {
+                break;
+            }
+            s.file.seek(0);
+            rewound = true;
+            continue;
+        }
+        filled += n;
+        rewound = false;
+    }
+    if (filled >= sizeof(int16_t)) {
+        s.block_len[b] = filled / sizeof(int16_t);
+    }
+    if (filled < want) {
+        s.eof = true;
+    }
+}
+
+// Refill the blocks the player handed back
+static void wave_task(void* parameter) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WAVE_TASK_IDLE_MS));
+        xSemaphoreTake(wave_mutex, portMAX_DELAY);
+        for (int i = 0; i < SOURCE_COUNT; i++) {
+            wave_state_t& s = waves[i];
+            if (!s.active || s.samples) {
+                continue;
+            }
+            for (int b = 0; b < 2 && !s.eof; b++) {
+                if (s.block_len[b] == 0) {
+                    wave_fill(s, b);
+                }
+            }
+        }
+        xSemaphoreGive(wave_mutex);
+    }
+}
+
+// Undo a partial wave_init(), so the next wave tries again
+static void wave_release() {
+    if (wave_mutex) {
+        vSemaphoreDelete(wave_mutex);
+        wave_mutex = NULL;
+    }
+    free(pool);
+    pool = NULL;
+}
+
+// Allocate the pool and start the loader on first use
+static bool wave_init() {
+    if (pool) {
+        return true;
+    }
+    pool = (int16_t*)malloc((WAVE_POOL_SAMPLES + SOURCE_COUNT * 2 * WAVE_STREAM_BLOCK) * sizeof(int16_t));
+    wave_mutex = xSemaphoreCreateMutex();
+    if (!pool || !wave_mutex) {
+        ESP_LOGE(TAG, "Failed to allocate the wave pool");
+        wave_release();
+        return false;
+    }
+    for (int i = 0; i < SOURCE_COUNT; i++) {
+        waves[i].blocks[0] = pool + WAVE_POOL_SAMPLES + (2 * i) * WAVE_STREAM_BLOCK;
+        waves[i].blocks[1] = pool + WAVE_POOL_SAMPLES + (2 * i + 1) * WAVE_STREAM_BLOCK;
+    }
+    BaseType_t result = xTaskCreatePinnedToCore(
+        wave_task,                // Task function
+        "wave_task",              // Task name
+        4096,                     // Stack size (bytes), LittleFS reads
+        NULL,                     // Task parameters
+        WAVE_TASK_PRIORITY,       // Ahead of the test loop, behind the samples
+        &wave_task_handle,        // Task handle
+        1                         // Core to run on (Core 1), next to signal_task
+    );
+    if (result != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create wave loader task");
+        wave_task_handle = NULL;
+        wave_release();
+        return false;
+    }
+    return true;
+}
+
+// Find a file in WAVE_DIR by the hash of its name
+static bool wave_find(uint32_t name_hash, char* name, size_t size) {
+    File dir = LittleFS.open(WAVE_DIR);
+    if (!dir || !dir.isDirectory()) {
+        return false;
+    }
+    bool found = false;
+    File file = dir.openNextFile();
+    while (file && !found) {
+        const char* file_name = file.name();
+        if (script_hash_update(SCRIPT_HASH_INIT, file_name, strlen(file_name)) == name_hash) {
+            snprintf(name, size, "%s", file_name);
+            found = true;
+        }
+        file.close();
+        file = dir.openNextFile();
+    }
+    dir.close();
+    return found;
+}
+
+static bool wave_playing_resident() {
+    for (int i = 0; i < SOURCE_COUNT; i++) {
+        if (waves[i].active && waves[i].samples) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Resident copy of a file, loading it when there is room. The pool starts over
+// when full, so it holds the files of the scripts run since. nullptr means stream.
+static const wave_resident_t* wave_resident(uint32_t name_hash, File& file, uint32_t length) {
+    if (pool_stale && !wave_playing_resident()) {
+        pool_used = 0;
+        resident_count = 0;
+        pool_stale = false;
+    }
+    if (!pool_stale) {
+        for (size_t i = 0; i < resident_count; i++) {
+            if (residents[i].hash == name_hash) {
+                return &residents[i];
+            }
+        }
+    }
+    if (resident_count == WAVE_POOL_FILES || length > WAVE_POOL_SAMPLES - pool_used) {
+        if (length > WAVE_POOL_SAMPLES || pool_stale || wave_playing_resident()) {
+            return nullptr;
+        }
+        pool_used = 0;
+        resident_count = 0;
+    }
+    size_t bytes = length * sizeof(int16_t);
+    if (file.read((uint8_t*)(pool + pool_used), bytes) != bytes) {
+        return nullptr;
+    }
+    wave_resident_t& entry = residents[resident_count++];
+    entry.hash = name_hash;
+    entry.offset = pool_used;
+    entry.length = length;
+    pool_used += length;
+    return &entry;
+}
+
+bool wave_open(source_net_t net, uint32_t name_hash, bool loop) {
+    if (net >= SOURCE_COUNT || !wave_init()) {
+        return false;
+    }
+    wave_close(net);
+
+    xSemaphoreTake(wave_mutex, portMAX_DELAY);
+    wave_state_t& s = waves[net];
+    char path[sizeof(WAVE_DIR) + WAVE_NAME_MAX];
+    if (!wave_find(name_hash, s.name, sizeof(s.name))) {
+        xSemaphoreGive(wave_mutex);
+        ESP_LOGE(TAG, "No file in %s matches wave %08lx", WAVE_DIR, (unsigned long)name_hash);
+        return false;
+    }
+    snprintf(path, sizeof(path), "%s/%s", WAVE_DIR, s.name);
+    File file = LittleFS.open(path, "r");
+    size_t size = file ? file.size() : 0;
+    if (size < sizeof(int16_t) || size % sizeof(int16_t) != 0) {
+        file.close();
+        xSemaphoreGive(wave_mutex);
+        ESP_LOGE(TAG, "%s holds %u bytes, expected int16 samples", path, (unsigned)size);
+        return false;
+    }
+
+    s.loop = loop;
+    s.done = false;
+    s.index = 0;
+    s.underruns = 0;
+    const wave_resident_t* resident = wave_resident(name_hash, file, size / sizeof(int16_t));
+    if (resident) {
+        s.samples = pool + resident->offset;
+        s.length = resident->length;
+        file.close();
+    } else {
+        // Both blocks are loaded before playback starts
+        file.seek(0);
+        s.samples = nullptr;
+        s.file = file;
+        s.block = 0;
+        s.eof = false;
+        s.block_len[0] = 0;
+        s.block_len[1] = 0;
+        wave_fill(s, 0);
+        if (!s.eof) {
+            wave_fill(s, 1);
+        }
+    }
+    s.active = true;
+    xSemaphoreGive(wave_mutex);
+
+    ESP_LOGD(TAG, "Wave %s: %u samples, %s", s.name, (unsigned)(size / sizeof(int16_t)),
+             resident ? "resident" : "streamed");
+    return true;
+}
+
+void wave_close(source_net_t net) {
+    if (net >= SOURCE_COUNT || !wave_mutex) {
+        return;
+    }
+    xSemaphoreTake(wave_mutex, portMAX_DELAY);
+    wave_state_t& s = waves[net];
+    if (s.active) {
+        s.active = false;
+        if (!s.samples) {
+            s.file.close();
+        }
+        if (s.underruns > 0) {
+            ESP_LOGW(TAG, "Wave %s waited for LittleFS on %lu ticks", s.name, (unsigned long)s.underruns);
+        }
+    }
+    xSemaphoreGive(wave_mutex);
+}
+
+int32_t wave_advance(source_net_t net, uint32_t steps) {
+    wave_state_t& s = waves[net];
+    if (!s.active) {
+        return 0;
+    }
+
+    if (s.samples) {
+        if (steps > 0 && !s.done) {
+            uint32_t next = s.index + steps;
+            if (next < s.length) {
+                s.index = next;
+            } else if (s.loop) {
+                s.index = next % s.length;
+            } else {
+                s.index = s.length - 1;
+                s.done = true;
+            }
+        }
+        return s.samples[s.index];
+    }
+
+    while (steps > 0 && !s.done) {
+        if (s.index + 1 < s.block_len[s.block]) {
+            s.index++;
+            steps--;
+            continue;
+        }
+        uint8_t next = s.block ^ 1;
+        if (s.block_len[next] == 0) {
+            if (s.eof) {
+                s.done = true;
+            } else {
+                s.underruns++;
+            }
+            break;
+        }
+        s.block_len[s.block] = 0;
+        s.block = next;
+        s.index = 0;
+        steps--;
+        if (wave_task_handle) {
+            xTaskNotifyGive(wave_task_handle);
+        }
+    }
+    return s.blocks[s.block][s.index];
+}
+
+const char* wave_name(source_net_t net) {
+    return (net < SOURCE_COUNT && waves[net].active) ? waves[net].name : "-";
+}
+
+void wave_invalidate() {
+    if (!wave_mutex) {
+        return;
+    }
+    xSemaphoreTake(wave_mutex, portMAX_DELAY);
+    pool_stale = true;
+    xSemaphoreGive(wave_mutex);
+}
@@ -6,6 +6,8 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include "modules.h"
+#include "script_parser.h"
+#include "wave_player.h"
 
 static const char* TAG = "webserver";
 
@@ -25,6 +27,11 @@ TaskHandle_t webserverTaskHandle = NULL;
 // WiFi state tracking
 volatile bool wifi_enabled = false;
 
+// Wave file being uploaded, written to a .tmp file and renamed once complete
+File waveUploadFile;
+String waveUploadPath = "";
+bool waveUploadOk = false;
+
 // Forward declarations
 void handleRoot();
 void handleGetModules();
@@ -32,6 +39,9 @@ void handleGetCurrent();
 void handleGetConfig();
 void handlePostConfig();
 void handleGetResults();
+void handleGetWaves();
+void handlePostWave();
+void handleWaveUpload();
 void handleNotFound();
 bool load_wifi_credentials();
 bool connect_to_wifi();
@@ -69,6 +79,8 @@ bool init_webserver() {
     server.on("/config", HTTP_GET, handleGetConfig);
     server.on("/config", HTTP_POST, handlePostConfig);
     server.on("/results", HTTP_GET, handleGetResults);
+    server.on("/waves", HTTP_GET, handleGetWaves);
+    server.on("/waves", HTTP_POST, handlePostWave, handleWaveUpload);
     server.onNotFound(handleNotFound);
     
     // Create web server task
@@ -350,12 +362,8 @@ void handlePostConfig() {
         ESP_LOGI(TAG, "Configuration updated successfully");
         server.send(200, "text/plain", "Configuration updated successfully");
         
-        // Only reinitialize if it's the current module
-        if (!server.hasArg("module")) {
-            if (!init_modules_from_fs()) {
-                ESP_LOGE(TAG, "Failed to initialize modules from filesystem");
-            }
-        }
+        // The main loop may be holding module pointers, it rebuilds the arena between runs
+        request_modules_reload();
     } else {
         ESP_LOGE(TAG, "No configuration data received");
         server.send(400, "text/plain", "No configuration data received");
@@ -392,6 +400,84 @@ void handleGetResults() {
     ESP_LOGI(TAG, "Test results sent successfully");
 }
 
+void handleGetWaves() {
+    ESP_LOGI(TAG, "GET /waves - Getting list of wave files");
+
+    String json = "[";
+    File dir = LittleFS.open(WAVE_DIR);
+    if (dir && dir.isDirectory()) {
+        bool first = true;
+        File file = dir.openNextFile();
+        while (file) {
+            String name = file.name();
+            if (!name.endsWith(".tmp")) {
+                if (!first) {
+                    json += ",";
+                }
+                json += "{\"name\":\"" + name + "\",\"samples\":" + String((int)(file.size() / 2)) + "}";
+                first = false;
+            }
+            file.close();
+            file = dir.openNextFile();
+        }
+        dir.close();
+    }
+    json += "]";
+
+    server.send(200, "application/json", json);
+}
+
+// Receives the multipart body of POST /waves in chunks
+void handleWaveUpload() {
+    HTTPUpload& upload = server.upload();
+    if (upload.status == UPLOAD_FILE_START) {
+        String name = upload.filename;
+        waveUploadPath = "";
+        waveUploadOk = name.length() > 0 && name.length() <= SCRIPT_WAVE_NAME_MAX &&
+                       name.indexOf('/') < 0 && name.indexOf(' ') < 0;
+        if (!waveUploadOk) {
+            ESP_LOGE(TAG, "Invalid wave file name: %s", name.c_str());
+            return;
+        }
+        LittleFS.mkdir(WAVE_DIR);
+        waveUploadPath = String(WAVE_DIR) + "/" + name;
+        waveUploadFile = LittleFS.open((waveUploadPath + ".tmp").c_str(), "w");
+        waveUploadOk = (bool)waveUploadFile;
+    } else if (upload.status == UPLOAD_FILE_WRITE) {
+        if (waveUploadOk) {
+            waveUploadOk = waveUploadFile.write(upload.buf, upload.currentSize) == upload.currentSize;
+        }
+    } else if (upload.status == UPLOAD_FILE_END || upload.status == UPLOAD_FILE_ABORTED) {
+        if (waveUploadFile) {
+            waveUploadFile.close();
+        }
+        // Whole int16 samples only, a partial file never replaces a good one
+        waveUploadOk = waveUploadOk && upload.status == UPLOAD_FILE_END &&
+                       upload.totalSize >= 2 && upload.totalSize % 2 == 0 &&
+                       LittleFS.rename((waveUploadPath + ".tmp").c_str(), waveUploadPath.c_str());
+        if (!waveUploadOk && waveUploadPath.length() > 0) {
+            LittleFS.remove((waveUploadPath + ".tmp").c_str());
+        }
+    }
+}
+
+void handlePostWave() {
+    ESP_LOGI(TAG, "POST /waves - Uploading wave file");
+
+    bool saved = waveUploadOk;
+    waveUploadOk = false;
+    if (!saved) {
+        ESP_LOGE(TAG, "Wave upload failed");
+        server.send(400, "text/plain", "Wave upload failed: expected a file of int16 samples named without spaces");
+        return;
+    }
+
+    // Resident copies of the old file are dropped
+    wave_invalidate();
+    ESP_LOGI(TAG, "Wave file %s saved", waveUploadPath.c_str());
+    server.send(200, "text/plain", "Wave file saved");
+}
+
 bool load_wifi_credentials() {    
     File wifiFile = LittleFS.open("/wifi", "r");
     if (!wifiFile) {
@@ -0,0 +1,113 @@
+// Host-side benchmark for the ADC median filter.
+//
+// Compares median_fixed() from include/median.h with the copy-and-sort
+// get_median() it replaced and with std::nth_element, on 15-sample sets of
+// 12-bit ADC-like readings. Every kernel's result is checked against the
+// sorted median first.
+//
+//   pio run -e bench_median -t exec
+//   .pio/build/bench_median/program [iterations]
+
+#include "median.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+// Matches MEDIAN_FILTER_SIZE in src/hal.cpp
+static const size_t FILTER_SIZE = 15;
+static const size_t SETS = 4096;
+
+// get_median() before median.h
+static int median_sort(int arr[], int size) {
+    int temp[size];
+    for (int i = 0; i < size; i++) {
+        temp[i] = arr[i];
+    }
+    std::sort(temp, temp + size);
+    return temp[size / 2];
+}
+
+static int median_nth(int arr[], int size) {
+    return median_any(arr, size);
+}
+
+// Same dispatch as get_median(): full windows through the network
+static int median_network(int arr[], int size) {
+    return size == FILTER_SIZE ? median_fixed<FILTER_SIZE>(arr) : median_any(arr, size);
+}
+
+typedef int (*kernel_t)(int arr[], int size);
+
+// Sample sets like a DC reading: a level with a few counts of noise and an
+// occasional spike, plus plain random sets that exercise every ordering
+static std::vector<int> make_sets(std::mt19937* rng) {
+    std::vector<int> samples(SETS * FILTER_SIZE);
+    std::uniform_int_distribution<int> level(0, 4095), noise(-8, 8), spike(0, 31), any(0, 4095);
+    for (size_t s = 0; s < SETS; s++) {
+        int base = level(*rng);
+        for (size_t i = 0; i < FILTER_SIZE; i++) {
+            int value = (s & 1) ? any(*rng) : base + noise(*rng) + (spike(*rng) == 0 ? 400 : 0);
+            samples[s * FILTER_SIZE + i] = std::max(0, std::min(4095, value));
+        }
+    }
+    return samples;
+}
+
+static double run(kernel_t kernel, std::vector<int>& samples, int iterations, long* checksum) {
+    auto start = std::chrono::steady_clock::now();
+    long sum = 0;
+    for (int it = 0; it < iterations; it++) {
+        for (size_t s = 0; s < SETS; s++) {
+            sum += kernel(&samples[s * FILTER_SIZE], FILTER_SIZE);
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    *checksum = sum;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ((double)iterations * SETS);
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    std::mt19937 rng(12345);
+    std::vector<int> samples = make_sets(&rng);
+
+    struct {
+        const char* name;
+        kernel_t kernel;
+    } kernels[] = {
+        {"sort", median_sort},
+        {"nth_element", median_nth},
+        {"network", median_network},
+    };
+
+    for (auto& k : kernels) {
+        for (size_t s = 0; s < SETS; s++) {
+            int* set = &samples[s * FILTER_SIZE];
+            std::vector<int> sorted(set, set + FILTER_SIZE);
+            std::sort(sorted.begin(), sorted.end());
+            if (k.kernel(set, FILTER_SIZE) != sorted[FILTER_SIZE / 2]) {
+                fprintf(stderr, "%s: wrong median for set %zu\n", k.name, s);
+                return 1;
+            }
+        }
+    }
+
+    printf("median of %zu samples, network of %zu comparators\n", FILTER_SIZE, median_network_size<FILTER_SIZE>());
+    printf("%-12s %10s\n", "kernel", "ns/median");
+    long reference = 0;
+    for (auto& k : kernels) {
+        long checksum;
+        double ns = run(k.kernel, samples, iterations, &checksum);
+        if (k.kernel == median_sort) {
+            reference = checksum;
+        } else if (checksum != reference) {
+            fprintf(stderr, "%s: checksum mismatch\n", k.name);
+            return 1;
+        }
+        printf("%-12s %10.1f\n", k.name, ns);
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Host-side benchmark for the module script parser.
+//
+// Parses every script in data/modules/ through the same streaming parser the
+// firmware uses, feeding it in firmware-sized chunks, and reports parse time
+// and heap allocations per file.
+//
+//   pio run -e bench_parse -t exec
+//   .pio/build/bench_parse/program [modules_dir] [iterations]
+
+#include "script_parser.h"
+#include <dirent.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Matches SCRIPT_READ_CHUNK in src/modules.cpp
+static const size_t CHUNK_SIZE = 512;
+
+static bool read_file(const std::string& path, std::vector<char>* data) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    char buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        data->insert(data->end(), buffer, buffer + len);
+    }
+    fclose(f);
+    return true;
+}
+
+static void parse_once(const std::vector<char>& data, script_parser_t* parser) {
+    script_parser_init(parser);
+    for (size_t offset = 0; offset < data.size(); offset += CHUNK_SIZE) {
+        size_t len = std::min(CHUNK_SIZE, data.size() - offset);
+        script_parser_feed(parser, data.data() + offset, len);
+    }
+    script_parser_finish(parser);
+}
+
+int main(int argc, char** argv) {
+    const char* modules_dir = argc > 1 ? argv[1] : "data/modules";
+    int iterations = argc > 2 ? atoi(argv[2]) : 10000;
+
+    DIR* dir = opendir(modules_dir);
+    if (!dir) {
+        fprintf(stderr, "Failed to open %s\n", modules_dir);
+        return 1;
+    }
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    printf("%-16s %7s %6s %5s %7s %11s\n", "module", "bytes", "lines", "ops", "allocs", "us/parse");
+
+    static script_parser_t parser;
+    for (const std::string& name : names) {
+        std::vector<char> data;
+        if (!read_file(std::string(modules_dir) + "/" + name, &data)) {
+            fprintf(stderr, "Failed to read %s\n", name.c_str());
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            parse_once(data, &parser);
+            script_parser_release(&parser);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double us = std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+
+        // One more pass to report what a single parse produces
+        parse_once(data, &parser);
+        printf("%-16s %7zu %6zu %5zu %7zu %11.2f\n", name.c_str(), data.size(),
+               parser.line_number, parser.count, parser.allocations, us);
+        script_parser_release(&parser);
+    }
+
+    return 0;
+}
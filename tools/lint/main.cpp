@@ -0,0 +1,488 @@
+// Host-side linter and cycle-time estimator for module test scripts.
+//
+// Runs every script through the firmware's own parser, prints its
+// diagnostics (unknown operations, bad pins, unbalanced braces, impossible
+// ranges, ...) and estimates how long the script takes on the test board.
+//
+//   pio run -e lint -t exec
+//   .pio/build/lint/program [-v] [script_or_dir ...]
+//
+// Exits with status 1 if any script has errors.
+
+#include "script_parser.h"
+#include "script_registry.h"
+#include "freq_sweep.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Cost model, in microseconds. The numbers follow the firmware code paths
+// named in the comments; timings of the hardware itself are typical values.
+
+// execute_test_sequence() waits delay(1) after every operation
+static const double OP_GAP_US = 1000;
+// One ESP_LOGI line (~80 characters) at 921600 baud
+static const double LOG_LINE_US = 870;
+// One analogRead() conversion
+static const double ANALOG_READ_US = 25;
+// hal_adc_read(): 15-sample median with delayMicroseconds(1) between samples
+static const double ADC_READ_US = 15 * (ANALOG_READ_US + 1);
+// measure_current_raw(): 15-sample median with delayMicroseconds(100) between samples
+static const double CURRENT_READ_US = 15 * (ANALOG_READ_US + 100);
+// Range checks stop once 8 of the 15 samples decide the median, best case
+static const double ADC_CHECK_US = 8 * (ANALOG_READ_US + 1);
+// ADC1 sinks (A..F) come from the adc_dma rings: after a stimulus a read waits
+// for 15 fresh samples, the six sinks share 200 kHz and fill in parallel
+static const double DMA_READ_US = 15 * 6 * 1e6 / 200000;
+static const int DMA_SINK_COUNT = 6;
+static const double CURRENT_CHECK_US = 8 * (ANALOG_READ_US + 100);
+// MCP23017 register access on the default 100 kHz I2C bus (9 bits per byte)
+static const double I2C_BYTE_US = 90;
+static const double I2C_WRITE_US = 3 * I2C_BYTE_US + 20;    // address, register, value
+static const double I2C_READ_US = 4 * I2C_BYTE_US + 20;     // address, register, address, value
+// One DAC8552 update over SPI, including hal_set_source() bookkeeping
+static const double DAC_WRITE_US = 30;
+// Sigscoper start: ADC driver configuration. Rates are timed when the scripts
+// load (measure_scope_rates()), outside the script.
+static const double SCOPE_START_US = 500;
+// check_signal_common() polls is_ready() every 10 ms
+static const double SCOPE_POLL_US = 10000;
+// settle_pin()/settle_current(): window of readings this far apart, best case
+static const double SETTLE_POLL_US = 5000;
+static const int SETTLE_WINDOW = 4;
+// wave_open(): /waves directory scan, then the whole file (up to 32 KB) or two stream blocks from LittleFS
+static const double WAVE_OPEN_US = 3000;
+// hal_source_calibrate(): 9 DAC codes, each settled 5 ms and read 8 times 1 ms apart
+static const double SOURCE_CAL_US = 9 * (5000 + DAC_WRITE_US + 8 * 1000);
+// get_power_rails_state() after every operation inside a loop reads the state cached
+// by the rail monitor task, no bus access
+static const double RAILS_CHECK_US = 1;
+
+// Estimator state carried from one operation to the next
+typedef struct {
+    double now_us;          // Time since the start of the script
+    double capture_done_us; // When the last scope capture completes
+    size_t swept;           // vmulti operations still served by the last sweep
+    uint16_t io_dir;        // mcp0 IODIR and OLAT shadows, as Micro_MCP23X17 keeps them
+    uint16_t io_out;
+    int scope_pin;          // Sink of the last scope capture, -1 for none or one a freq check took
+    double delay_until_us;  // Deadline of a pending delay, 0 for none
+} estimate_t;
+
+// Wait out a pending delay, as wait_pending_delay() does
+static void estimate_wait_delay(estimate_t* est) {
+    if (est->delay_until_us > 0) {
+        est->now_us = std::max(est->now_us, est->delay_until_us);
+        est->delay_until_us = 0;
+    }
+}
+
+// hal_adc_read() of one sink, range checks take the full median from the rings too
+static double adc_read_us(uint8_t sink, double sampled_us) {
+    return sink < DMA_SINK_COUNT ? DMA_READ_US : sampled_us;
+}
+
+// Register writes a shadow update costs: one per port whose byte changes
+static int register_writes(uint16_t before, uint16_t after) {
+    uint16_t changed = before ^ after;
+    return ((changed & 0x00FF) ? 1 : 0) + ((changed & 0xFF00) ? 1 : 0);
+}
+
+// Charge the ADC sweep of a run of consecutive vmulti operations to its first one,
+// as check_swept_pin() does
+static void estimate_sweep(estimate_t* est, const test_operation_t* ops, size_t i, size_t end) {
+    if (ops[i].op != TEST_OP_CHECK_PIN_MULTI || est->swept > 0) {
+        return;
+    }
+    if (!script_op_runs_in_delay(ops[i])) {
+        estimate_wait_delay(est);
+    }
+    size_t run = 0;
+    size_t sampled = 0;
+    while (i + run < end && run < ADC_sink_count && ops[i + run].op == TEST_OP_CHECK_PIN_MULTI) {
+        sampled += ops[i + run].pin >= DMA_SINK_COUNT;
+        run++;
+    }
+    est->now_us += (sampled < run ? DMA_READ_US : 0) + sampled * ADC_READ_US + LOG_LINE_US;
+    est->swept = run;
+}
+
+// Advance the estimate by one operation
+static void estimate_operation(estimate_t* est, const test_operation_t& op) {
+    if (op.op != TEST_OP_DELAY && !script_op_runs_in_delay(op)) {
+        estimate_wait_delay(est);
+    }
+
+    double cost = 0;
+    switch (op.op) {
+        case TEST_OP_SOURCE:
+            cost = DAC_WRITE_US + LOG_LINE_US;
+            break;
+        case TEST_OP_SOURCE_SIG:
+            cost = DAC_WRITE_US + LOG_LINE_US;
+            break;
+        case TEST_OP_SOURCE_WAVE:
+            cost = WAVE_OPEN_US + LOG_LINE_US;
+            break;
+        case TEST_OP_IO: {
+            // hal_set_io() writes OLAT and IODIR only when they change
+            uint16_t bit = 1u << (op.pin & 15);
+            uint16_t dir = op.arg1 == IO_INPUT ? (est->io_dir | bit) : (est->io_dir & ~bit);
+            uint16_t out = op.arg1 == IO_INPUT ? est->io_out : op.arg1 == IO_HIGH ? (est->io_out | bit) : (est->io_out & ~bit);
+            int writes = register_writes(est->io_dir, dir) + register_writes(est->io_out, out);
+            est->io_dir = dir;
+            est->io_out = out;
+            cost = writes * I2C_WRITE_US + LOG_LINE_US;
+            break;
+        }
+        case TEST_OP_CHECK_IO_LEVEL:
+            cost = I2C_READ_US + LOG_LINE_US;
+            break;
+        case TEST_OP_IO_PORT: {
+            // hal_set_io_port() flushes all pins at once
+            uint16_t mask = op.arg2 & 0xFFFF;
+            uint16_t inputs = (uint32_t)op.arg2 >> 16;
+            uint16_t dir = (est->io_dir & ~mask) | inputs;
+            uint16_t out = (est->io_out & ~(mask & ~inputs)) | (op.arg1 & mask & ~inputs);
+            int writes = register_writes(est->io_dir, dir) + register_writes(est->io_out, out);
+            est->io_dir = dir;
+            est->io_out = out;
+            cost = writes * I2C_WRITE_US + LOG_LINE_US;
+            break;
+        }
+        case TEST_OP_CHECK_IO_LEVELS:
+            // readGPIOAB(): one read of both ports
+            cost = I2C_READ_US + I2C_BYTE_US + LOG_LINE_US;
+            break;
+        case TEST_OP_SINK_PD:
+            // Best case: the pin is already an output, only OLAT changes
+            cost = I2C_WRITE_US + LOG_LINE_US;
+            break;
+        case TEST_OP_CHECK_CURRENT:
+            cost = CURRENT_CHECK_US + LOG_LINE_US;
+            break;
+        case TEST_OP_CHECK_PIN:
+            cost = adc_read_us(op.pin, ADC_CHECK_US) + LOG_LINE_US;
+            break;
+        case TEST_OP_CHECK_PIN_MULTI:
+            // The sweep is charged by estimate_sweep(), only its last check waits the gap
+            if (--est->swept > 0) {
+                return;
+            }
+            break;
+        case TEST_OP_RESET:
+            // hal_reset_io() writes the IODIR ports that still have outputs, four sources,
+            // one IODIR write for the pulldown pins
+            cost = register_writes(est->io_dir, 0xFFFF) * I2C_WRITE_US + SOURCE_COUNT * DAC_WRITE_US + I2C_WRITE_US + LOG_LINE_US;
+            est->io_dir = 0xFFFF;
+            break;
+        case TEST_OP_SCOPE:
+            cost = SCOPE_START_US + LOG_LINE_US;
+            est->capture_done_us = est->now_us + cost + 1e6 * (double)op.arg2 / (double)op.arg1;
+            est->scope_pin = op.pin;
+            break;
+        case TEST_OP_CHECK_FREQ:
+            // Without a scope on the pin, check_signal_freq() plans and starts its own
+            // capture, which the next freq check does not reuse
+            if (est->scope_pin != op.pin) {
+                uint32_t rate = freq_capture_rate(op.arg2);
+                est->now_us += SCOPE_START_US;
+                est->capture_done_us = est->now_us + 1e6 * (double)freq_capture_buffer(rate, op.arg1) / rate;
+                est->scope_pin = -1;
+            }
+            // fall through
+        case TEST_OP_CHECK_MIN:
+        case TEST_OP_CHECK_MAX:
+        case TEST_OP_CHECK_AVG:
+        case TEST_OP_CHECK_AMPLITUDE:
+            // The capture runs in the background until the first check waits for it
+            if (est->capture_done_us > est->now_us) {
+                double polls = (est->capture_done_us - est->now_us) / SCOPE_POLL_US;
+                est->now_us += SCOPE_POLL_US * (double)(long)(polls + 0.999999);
+            }
+            cost = LOG_LINE_US;
+            break;
+        case TEST_OP_SWEEP: {
+            // run_freq_sweep(): per point the settle wait, a capture polled like the scope
+            // checks and a log line; the Goertzel run overlaps the settle of the next point
+            int points = SWEEP_ARG1_POINTS(op.arg1);
+            for (int i = 0; i < points; i++) {
+                double freq = sweep_point_freq(op.arg2, op.arg3, points, i);
+                double capture_us = 1e6 * SWEEP_BUFFER / sweep_sample_rate(freq);
+                cost += 1000.0 * sweep_settle_ms(freq) + DAC_WRITE_US + SCOPE_START_US +
+                        SCOPE_POLL_US * std::ceil(capture_us / SCOPE_POLL_US) + LOG_LINE_US;
+            }
+            cost += DAC_WRITE_US + LOG_LINE_US;
+            est->scope_pin = -1;
+            break;
+        }
+        case TEST_OP_CHECK_CUTOFF:
+        case TEST_OP_CHECK_SLOPE:
+        case TEST_OP_CHECK_PEAK:
+            cost = LOG_LINE_US;
+            break;
+        case TEST_OP_DELAY:
+            // The delay becomes a deadline for the next operation that has to
+            // wait, its log line runs inside the window and no gap or rails check follows it
+            est->delay_until_us = std::max(est->now_us, est->delay_until_us) + 1000.0 * op.arg1;
+            est->now_us += LOG_LINE_US;
+            return;
+        case TEST_OP_SETTLE:
+            // Best case: the first full window already agrees
+            cost = SETTLE_WINDOW * adc_read_us(op.pin, ADC_READ_US) + (SETTLE_WINDOW - 1) * SETTLE_POLL_US + LOG_LINE_US;
+            break;
+        case TEST_OP_CALIBRATE_SOURCE:
+            cost = SOURCE_CAL_US + 8 * 9 * adc_read_us(op.arg1, ADC_READ_US) + LOG_LINE_US;
+            break;
+        case TEST_OP_SETTLE_CURRENT:
+            cost = SETTLE_WINDOW * CURRENT_READ_US + (SETTLE_WINDOW - 1) * SETTLE_POLL_US + LOG_LINE_US;
+            break;
+        default:
+            break;
+    }
+    est->now_us += cost + OP_GAP_US;
+}
+
+static bool is_infinite_loop(const test_operation_t& op) {
+    return op.op == TEST_OP_LOOP_START && op.arg1 == 0 && op.arg2 == 0;
+}
+
+// Advance the estimate over ops[begin, end), expanding counted and timed
+// loops. Stops at the first infinite loop and returns its index, or end.
+static size_t estimate_range(estimate_t* est, const test_operation_t* ops, size_t begin, size_t end, bool in_loop) {
+    size_t i = begin;
+    while (i < end) {
+        const test_operation_t& op = ops[i];
+        if (is_infinite_loop(op)) {
+            return i;
+        }
+        if (op.op != TEST_OP_LOOP_START) {
+            estimate_sweep(est, ops, i, end);
+            estimate_operation(est, op);
+            est->now_us += in_loop && op.op != TEST_OP_DELAY ? RAILS_CHECK_US : 0;
+            i++;
+            continue;
+        }
+
+        // First iteration, then scale by the iterations the limit allows
+        size_t close = (size_t)op.pin;
+        est->now_us += LOG_LINE_US;
+        double start = est->now_us;
+        size_t stop = estimate_range(est, ops, i + 1, close, true);
+        if (stop != close) {
+            return stop;
+        }
+        estimate_wait_delay(est);
+        est->now_us += RAILS_CHECK_US;
+        double iteration = est->now_us - start;
+        double iterations = op.arg1 > 0 ? op.arg1 : std::max(1.0, std::ceil(1000.0 * op.arg2 / iteration));
+        est->now_us += (iterations - 1) * iteration;
+        i = close + 1;
+    }
+    return end;
+}
+
+// Time of one cycle of the infinite loop starting at ops[start]
+static double estimate_cycle(estimate_t* est, const test_operation_t* ops, size_t start) {
+    est->now_us += LOG_LINE_US;
+    double begin = est->now_us;
+    estimate_range(est, ops, start + 1, (size_t)ops[start].pin, true);
+    estimate_wait_delay(est);
+    est->now_us += RAILS_CHECK_US;
+    return est->now_us - begin;
+}
+
+typedef struct {
+    const char* path;
+    size_t errors;
+} lint_ctx_t;
+
+static void print_diag(void* ctx, script_diag_level_t level, size_t line, const char* message) {
+    lint_ctx_t* lint = (lint_ctx_t*)ctx;
+    fprintf(stderr, "%s:%zu: %s: %s\n", lint->path, line,
+            level == SCRIPT_DIAG_ERROR ? "error" : "warning", message);
+}
+
+static bool read_file(const std::string& path, std::vector<char>* data) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    char buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        data->insert(data->end(), buffer, buffer + len);
+    }
+    fclose(f);
+    return true;
+}
+
+// Count src_wav operations whose file is not in the waves directory next to the
+// script's directory (data/waves for data/modules), which uploadfs copies to /waves
+static size_t check_waves(const std::string& path, const test_operation_t* ops, size_t count) {
+    size_t slash = path.find_last_of('/');
+    std::string dir = (slash == std::string::npos ? std::string(".") : path.substr(0, slash)) + "/../waves";
+    std::vector<uint32_t> hashes;
+    if (DIR* waves = opendir(dir.c_str())) {
+        while (struct dirent* entry = readdir(waves)) {
+            hashes.push_back(script_hash_update(SCRIPT_HASH_INIT, entry->d_name, strlen(entry->d_name)));
+        }
+        closedir(waves);
+    }
+    size_t missing = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (ops[i].op == TEST_OP_SOURCE_WAVE &&
+            std::find(hashes.begin(), hashes.end(), (uint32_t)ops[i].arg1) == hashes.end()) {
+            fprintf(stderr, "%s: warning: operation %zu plays a file missing from %s\n", path.c_str(), i, dir.c_str());
+            missing++;
+        }
+    }
+    return missing;
+}
+
+// Lint one script, returns the number of errors
+static size_t lint_script(const std::string& path, bool verbose) {
+    std::vector<char> data;
+    if (!read_file(path, &data)) {
+        fprintf(stderr, "%s: cannot read\n", path.c_str());
+        return 1;
+    }
+
+    lint_ctx_t ctx = {path.c_str(), 0};
+    static script_parser_t parser;
+    script_parser_init(&parser);
+    script_parser_set_diag(&parser, print_diag, &ctx);
+    script_parser_feed(&parser, data.data(), data.size());
+    script_parser_finish(&parser);
+
+    const test_operation_t* ops = parser.ops;
+    size_t count = parser.count;
+    size_t warnings = parser.warnings + check_waves(path, ops, count);
+
+    // Setup runs until the first infinite loop, which then cycles until the module is removed
+    estimate_t est = {0, 0, 0, 0, 0, -1, 0};
+    size_t infinite = estimate_range(&est, ops, 0, count, false);
+    if (infinite == count) {
+        estimate_wait_delay(&est);
+    }
+    double setup_us = est.now_us;
+    double loop_us = infinite < count ? estimate_cycle(&est, ops, infinite) : 0;
+
+    size_t repeats = 0;
+    for (size_t i = 0; i < count; i++) {
+        repeats += ops[i].repeat && !script_op_is_control(ops[i].op) ? 1 : 0;
+    }
+
+    const char* name = strrchr(path.c_str(), '/');
+    name = name ? name + 1 : path.c_str();
+    printf("%-16s %5zu %6zu %8zu %10.1f %10.1f %7zu\n", name, count, parser.errors, warnings,
+           setup_us / 1000.0, loop_us / 1000.0, repeats);
+
+    if (verbose && parser.limits.deadline_ms > 0) {
+        printf("    deadline %lu ms\n", (unsigned long)parser.limits.deadline_ms);
+    }
+    if (verbose) {
+        // Single execution of each operation, loops are not expanded
+        estimate_t op_est = {0, 0, 0, 0, 0, -1, 0};
+        int depth = 0;
+        for (size_t i = 0; i < count; i++) {
+            const test_operation_t& op = ops[i];
+            if (op.op == TEST_OP_LOOP_START) {
+                if (op.arg1 > 0) {
+                    printf("    %*s{ %ld\n", 2 * depth, "", (long)op.arg1);
+                } else if (op.arg2 > 0) {
+                    printf("    %*s{ %ldms\n", 2 * depth, "", (long)op.arg2);
+                } else {
+                    printf("    %*s{\n", 2 * depth, "");
+                }
+                depth++;
+                continue;
+            }
+            if (op.op == TEST_OP_LOOP_END) {
+                depth--;
+                printf("    %*s}\n", 2 * depth, "");
+                continue;
+            }
+            double start = op_est.now_us;
+            estimate_sweep(&op_est, ops, i, count);
+            estimate_operation(&op_est, op);
+            if (op.op == TEST_OP_DELAY) {
+                // Listed with its whole window, operations are not overlapped here
+                estimate_wait_delay(&op_est);
+            }
+            uint32_t retry_ms = op.timeout_ms ? op.timeout_ms : parser.limits.retry_timeout_ms;
+            char retry[48] = "";
+            if (op.repeat && retry_ms > 0) {
+                snprintf(retry, sizeof(retry), "  (+ retried for up to %lu ms)", (unsigned long)retry_ms);
+            } else if (op.repeat) {
+                snprintf(retry, sizeof(retry), "  (+ retried until it passes)");
+            }
+            printf("    %*s%4zu %-10s %9.2f ms%s\n", 2 * depth, "", i, script_op_keyword(op.op),
+                   (op_est.now_us - start) / 1000.0, retry);
+        }
+    }
+
+    size_t errors = parser.errors;
+    script_parser_release(&parser);
+    return errors;
+}
+
+static bool is_directory(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void collect_scripts(const char* path, std::vector<std::string>* scripts) {
+    if (!is_directory(path)) {
+        scripts->push_back(path);
+        return;
+    }
+    DIR* dir = opendir(path);
+    if (!dir) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return;
+    }
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    for (const std::string& name : names) {
+        scripts->push_back(std::string(path) + "/" + name);
+    }
+}
+
+int main(int argc, char** argv) {
+    bool verbose = false;
+    std::vector<std::string> scripts;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else {
+            collect_scripts(argv[i], &scripts);
+        }
+    }
+    if (scripts.empty()) {
+        collect_scripts("data/modules", &scripts);
+    }
+
+    // Times are best case: "+" operations are counted once, "loop ms" is one
+    // cycle of the first infinite loop
+    printf("%-16s %5s %6s %8s %10s %10s %7s\n", "module", "ops", "errors", "warnings", "setup ms", "loop ms", "retried");
+
+    size_t errors = 0;
+    for (const std::string& script : scripts) {
+        errors += lint_script(script, verbose);
+    }
+
+    return errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+// Host-side test of the delay window rule.
+//
+// Parses short scripts with the firmware parser and replays them through
+// delay_window.h, the deadline logic execute_test_sequence() uses, on a
+// simulated clock where every operation takes OP_MS. Checks that operations
+// which could observe the module's response to an actuation still start a
+// full delay after it, and that only sweep results and "&" checks run early.
+//
+//   pio run -e test_delay -t exec
+//   .pio/build/test_delay/program
+
+#include "script_parser.h"
+#include "delay_window.h"
+#include <cstdio>
+#include <cstring>
+
+// One operation plus the inter-op gap
+static const uint32_t OP_MS = 1;
+
+static size_t failures = 0;
+
+static bool parse(const char* text, script_parser_t* parser) {
+    script_parser_init(parser);
+    script_parser_feed(parser, text, strlen(text));
+    script_parser_finish(parser);
+    return parser->errors == 0;
+}
+
+// Start time of every operation, as execute_test_sequence() would schedule it
+static void schedule(const script_parser_t& parser, uint32_t* starts) {
+    delay_window_t window = {false, 0};
+    uint32_t now = 0;
+    for (size_t i = 0; i < parser.count; i++) {
+        const test_operation_t& op = parser.ops[i];
+        if (op.op == TEST_OP_DELAY) {
+            delay_window_add(&window, now, op.arg1);
+            starts[i] = now;
+            continue;
+        }
+        now += delay_window_wait(&window, &op, now);
+        starts[i] = now;
+        now += OP_MS;
+    }
+}
+
+// Operation index of script starts at expected ms
+static void expect_start(const char* name, const char* text, size_t index, uint32_t expected) {
+    static script_parser_t parser;
+    uint32_t starts[16] = {0};
+    if (!parse(text, &parser) || parser.count > 16 || index >= parser.count) {
+        printf("FAIL %s: script does not parse\n", name);
+        failures++;
+        script_parser_release(&parser);
+        return;
+    }
+    schedule(parser, starts);
+    bool ok = starts[index] == expected;
+    printf("%s %s: operation %zu starts at %lu ms, expected %lu ms\n", ok ? "ok  " : "FAIL", name, index,
+           (unsigned long)starts[index], (unsigned long)expected);
+    failures += ok ? 0 : 1;
+    script_parser_release(&parser);
+}
+
+static void expect_error(const char* name, const char* text) {
+    static script_parser_t parser;
+    bool ok = !parse(text, &parser);
+    printf("%s %s: %s\n", ok ? "ok  " : "FAIL", name, ok ? "rejected" : "accepted");
+    failures += ok ? 0 : 1;
+    script_parser_release(&parser);
+}
+
+int main() {
+    // The step at 0 ms ends at OP_MS, a 5 ms delay holds the next check until 6 ms
+    expect_start("io; delay; i waits the full delay", "io 0 h\ndelay 5\ni +12 0 50000\n", 2, OP_MS + 5);
+    expect_start("io; delay; iolevel waits the full delay", "io 0 h\ndelay 5\niolevel 4 h\n", 2, OP_MS + 5);
+    expect_start("src; delay; i waits the full delay", "src A 1000\ndelay 5\ni +5 0 50000\n", 2, OP_MS + 5);
+    expect_start("checks after the first one need no wait", "io 0 h\ndelay 5\ni +12 0 50000\ni +5 0 50000\n", 3,
+                 OP_MS + 5 + OP_MS);
+    expect_start("delays add up", "io 0 h\ndelay 5\ndelay 5\niolevel 4 h\n", 3, OP_MS + 10);
+    expect_start("retried check waits", "io 0 h\ndelay 5\niolevel 4 h +\n", 2, OP_MS + 5);
+
+    // Only an explicit "&" lets a check into the window, the next plain one still waits
+    expect_start("& check runs in the window", "io 0 h\ndelay 5\ni +12 0 50000 &\n", 2, OP_MS);
+    expect_start("& with a repeat marker", "io 0 h\ndelay 5\niolevel 4 h + &\n", 2, OP_MS);
+    expect_start("plain check after an & one waits", "io 0 h\ndelay 5\ni +12 0 50000 &\niolevel 4 h\n", 3, OP_MS + 5);
+
+    expect_error("& on an actuation", "src A 100 &\n");
+    expect_error("& on a delay", "delay 5 &\n");
+
+    printf("%zu failure(s)\n", failures);
+    return failures ? 1 : 0;
+}